@@ -3,8 +3,10 @@
 
 #define __PGD_DEBUG 0
 #define __PGD_DEBUG2 0 //数据读取debug
+#define PGD_FLAT_BAND_ROWS 64 ///<平坦掩码的行带高度（按整幅图像的行号对齐），固定值使掩码与线程数和分片位置无关
 
 #include <opencv2/opencv.hpp>
+#include <memory>
 
 /// @file  PGD.h
 /// @brief 定义了PGD算子（实验性）
@@ -37,6 +39,80 @@ public:
 		PGD_SampleNums_64 = 64
 	};
 
+	/*!
+	 * @brief 底层接口中输入像素的类型，三通道和四通道按BGR(A)排列
+	 */
+	enum PGD_PixelType {
+		PGD_PixelType_U8C1 = CV_8UC1,
+		PGD_PixelType_U8C3 = CV_8UC3,
+		PGD_PixelType_U8C4 = CV_8UC4,
+		PGD_PixelType_U16C1 = CV_16UC1,
+		PGD_PixelType_F32C1 = CV_32FC1,
+		PGD_PixelType_F64C1 = CV_64FC1
+	};
+
+	/*!
+	 * @brief 底层接口的输出内存分配回调
+	 * @param rows 输出的行数
+	 * @param row_bytes 每一行最少需要的字节数
+	 * @param step [输出] 实际分配的每行字节数（不能小于row_bytes）
+	 * @param user_data 调用者传入的用户数据
+	 * @return 分配好的内存首地址，返回nullptr表示分配失败
+	 */
+	typedef void *(*PGD_Allocator)(int rows, size_t row_bytes, size_t *step, void *user_data);
+
+	/*!
+	 * @brief 遍历全图的策略
+	 */
+	enum PGD_TraverseStrategy {
+		PGD_Traverse_PixelWise = 0,///< 逐像素计算所有【环点】和【子环点】（原始方法）
+		PGD_Traverse_RowWise = 1,///< 逐行计算，每个【子环点】先对整行插值，再整行比较，便于向量化
+		PGD_Traverse_Tiled2D = 2///< 二维分块，块连同上下左右R宽的边缘一起放入缓存预算，块内逐行计算，适合宽图像和大半径
+	};
+
+	/*!
+	 * @brief 【子环点】的采样方式
+	 */
+	enum PGD_SampleMode {
+		PGD_Sample_Bilinear = 0,///< 二次线性插值（田字格内的4个像素）
+		PGD_Sample_BoxIntegral = 1///< 区域均值：以【子环点】为中心、大小随radius_2变化的方框均值，由积分图常数时间得到
+	};
+
+	/*!
+	 * @brief 自动调优模式
+	 */
+	enum PGD_TuneMode {
+		PGD_Tune_Default = 0,///< 由环境变量 PGD_AUTOTUNE 决定（1/on/auto 为自动，force 为强制），未设置时等同于 PGD_Tune_Disable
+		PGD_Tune_Auto = 1,///< 已有记录则直接使用，否则先调优再记录（设置了 PGD_TUNING_FILE 时同时写入该文件）
+		PGD_Tune_Force = 2,///< 无论是否有记录都重新调优并覆盖记录
+		PGD_Tune_Disable = 3///< 不调优，直接使用 Struct_PGD::exec_config
+	};
+
+	/*!
+	 * @brief 输出内存与工作缓冲区（填充过的double图像）的分配策略（仅Linux，其他平台总是 PGD_Mem_Plain）
+	 * @note 多路服务器上页面落在第一次写入它的线程所在的NUMA节点，普通分配时这是调用线程或预处理线程，
+	 * 其他节点上的计算线程都要跨节点访问；按计算的行带划分并行写入每一页，页面就分散到各个计算线程所在的节点
+	 */
+	enum PGD_MemPolicy {
+		PGD_Mem_Default = 0,///< 由 set_MemPolicy() 设置的全局策略决定，未设置时由环境变量 PGD_MEMPOLICY（plain / firsttouch / hugepage）决定，都没有时等同于 PGD_Mem_Plain
+		PGD_Mem_Plain = 1,///< 普通分配
+		PGD_Mem_FirstTouch = 2,///< 分配后按计算的行带划分并行写入每一页
+		PGD_Mem_HugePage = 3///< 先用 madvise(MADV_HUGEPAGE) 请求透明大页，再按 PGD_Mem_FirstTouch 写入
+	};
+
+	/*!
+	 * @struct Struct_ExecConfig
+	 * @brief 遍历的执行配置：遍历策略、行带高度、线程数
+	 * @note 分块策略下 band_rows 为块高，与 tile_cols 一样为0时按缓存预算自动选择
+	 */
+	struct Struct_ExecConfig {
+		PGD_TraverseStrategy strategy = PGD_Traverse_PixelWise;
+		int band_rows = 0;///<每个并行任务处理的行数，0表示按线程数自动划分
+		int n_threads = 0;///<同时运行的线程数上限（通过 parallel_for_ 的 nstripes 限制，不修改OpenCV的全局设置），0表示不限制
+		int tile_cols = 0;///<分块策略的块宽，0表示按缓存预算自动选择
+		int cache_kb = 0;///<分块策略的缓存预算（KB），0表示默认的512KB
+	};
+
 	/*!
 	 * @struct Struct_PGD
 	 * @brief 对外调用接口
@@ -52,9 +128,21 @@ public:
 		PGD_SampleNums n_sample = PGD_SampleNums_SameAs_N_Sample;
 		PGD_SampleNums n2_sample = PGD_SampleNums_SameAs_N_Sample;
 		cv::Mat PGD;///<数据结果
+		PGD_SampleMode sample_mode = PGD_Sample_Bilinear;///<【子环点】的采样方式（只对calc_PGDFilter有效）
+		PGD_TuneMode tune_mode = PGD_Tune_Default;///<自动调优模式
+		Struct_ExecConfig exec_config;///<执行配置，调优关闭时作为输入，计算后写回实际使用的配置
+		double flat_threshold = 0;///<平坦区域快速路径的方差阈值（按遍历时的输入计算，calc_PGDFilter 中为[0,1]），0表示关闭
+		uint64 flat_code = 0;///<平坦像素每个通道直接写入的G值
+		int64 flat_count = 0;///<[输出] 上一次计算中走快速路径的像素数
+		PGD_MemPolicy mem_policy = PGD_Mem_Default;///<输出内存（构造时）与工作缓冲区（每次计算时）的分配策略
+		PGD_MemPolicy mem_policy_dst = PGD_Mem_Plain;///<[输出] 输出内存实际生效的策略，使用外部内存时为 PGD_Mem_Plain
+		PGD_MemPolicy mem_policy_work = PGD_Mem_Plain;///<[输出] 上一次计算中工作缓冲区实际生效的策略
+
 
+		Struct_PGD(int _rows, int _cols, PGD_SampleNums _n_sample, PGD_SampleNums _n2_sample,
+		           PGD_MemPolicy _mem_policy = PGD_Mem_Default);
 
-		Struct_PGD(int _rows, int _cols, PGD_SampleNums _n_sample, PGD_SampleNums _n2_sample);
+		Struct_PGD(int _rows, int _cols, PGD_SampleNums _n_sample, PGD_SampleNums _n2_sample, void *_data, size_t _step);///<使用外部内存，不分配也不释放
 
 
 		template<typename T>
@@ -115,6 +203,7 @@ public:
 		int count2 = 0;
 		int n2_sample;
 		double r2 = 0;
+		int pad = 0;///<遍历时输入图像四周的填充大小，默认为ceil(r1 + r2)
 		double ***arr_InterpWeight;///<存放权重的指针，指向[n_sample][n2_sample][4]的三维数组
 		short ***arr_InterpOffsetX;///<存放每个采样点插值所需的参考点相对于中心点的X偏移量
 		short ***arr_InterpOffsetY;///<存放每个采样点插值所需的参考点相对于中心点的Y偏移量
@@ -128,22 +217,104 @@ public:
 	static cv::Mat
 	calc_PGDFilter44_Int(const cv::_InputArray &_src, Struct_PGD &_struct_dst, int radius, int radius_2);
 
+	static bool
+	calc_PGDFilter_Raw(const void *src_data, int width, int height, size_t src_stride, PGD_PixelType src_type,
+	                   void *dst_data, size_t dst_stride,
+	                   PGD_SampleNums n_sample, PGD_SampleNums n2_sample, double radius, double radius_2);
+
+	static void *
+	calc_PGDFilter_Raw(const void *src_data, int width, int height, size_t src_stride, PGD_PixelType src_type,
+	                   PGD_Allocator allocator, void *user_data, size_t *dst_stride,
+	                   PGD_SampleNums n_sample, PGD_SampleNums n2_sample, double radius, double radius_2);
+
+	static size_t calc_DstRowBytes(int cols, PGD_SampleNums n_sample, PGD_SampleNums n2_sample);
+
+	static const char *get_KernelISA();
+
+	static void set_MemPolicy(PGD_MemPolicy policy);
+
+	static const char *get_MemPolicyName(PGD_MemPolicy policy);
+
+	static cv::Mat calc_HammingMap(const Struct_PGD &struct_a, const Struct_PGD &struct_b, int window = 1);
+
+	static cv::Mat
+	calc_PGDChangeMap(const Struct_PGD &struct_ref, const cv::_InputArray &_src, double radius, double radius_2, int window = 1);
+
 private:
+	friend class PGDAsyncClass_;
+	friend class PGDShardClass_;
+
+	static cv::Mat
+	def_DstMat(int rows, int cols, PGD_SampleNums n_sample, PGD_SampleNums n2_sample, PGD_MemPolicy mem_policy,
+	           PGD_MemPolicy &mem_applied);
 
 	static cv::Mat
-	def_DstMat(int rows, int cols, PGD_SampleNums n_sample, PGD_SampleNums n2_sample);
+	def_PolicyMat(int rows, int cols, int type, PGD_MemPolicy mem_policy, const Struct_ExecConfig &config, int pad,
+	              PGD_MemPolicy &mem_applied);
+
+	static PGD_MemPolicy calc_MemPolicy(PGD_MemPolicy mem_policy);
+
+	static int calc_BandRows(const Struct_ExecConfig &config, int rows);
+
+	static int def_DstType(PGD_SampleNums n_sample, PGD_SampleNums n2_sample);
+
+	static bool calc_PGDFilterChecked(const cv::_InputArray &_src, Struct_PGD &_struct_dst, double radius, double radius_2);
+
+	static std::unique_ptr<Struct_N4InterpList>
+	calc_PrepareN4(const cv::Mat &src, const Struct_PGD &struct_cfg, double radius, double radius_2, cv::Mat &src_double,
+	               cv::Mat *flat_mask = nullptr, PGD_MemPolicy *mem_applied = nullptr, int flat_origin = 0);
+
+	static void calc_FusedPreprocess(const cv::Mat &src, cv::Mat &dst, int R, double scale);
 
 	static inline void calc_CircleOffset(Struct_SampleOffsetList &struct_sampleOffset, int n_sample, double radius);
 
 	static void
 	calc_N4_QuadraticInterpolationInit(Struct_N4InterpList &struct_n4Interp);
 
+	static int calc_BoxHalfSize(int n2_sample, double radius_2);
+
+	static void
+	calc_Box_IntegralInit(Struct_N4InterpList &struct_n4Interp, int box_half);
+
 	static void
 	calc_N4PGD_Traverse(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp);
 
 	static void
 	calc_44IntPGD_Traverse(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp);
 
+	static void
+	calc_N4PGD_TraverseRow(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp);
+
+	static void
+	calc_44IntPGD_TraverseRow(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp);
+
+	static void
+	calc_ParallelTraverse(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp,
+	                      const Struct_ExecConfig &config, bool is_44Int, const cv::Mat &flat_mask = cv::Mat(),
+	                      uint64 flat_code = 0);
+
+	static void
+	calc_TileSize(const Struct_ExecConfig &config, int rows, int cols, int R, int n2_sample, size_t dst_elem_size,
+	              int &tile_rows, int &tile_cols);
+
+	static void
+	calc_Traverse(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp,
+	              PGD_TraverseStrategy strategy, bool is_44Int);
+
+	static void
+	calc_TraverseMasked(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp,
+	                    PGD_TraverseStrategy strategy, bool is_44Int, const cv::Mat &flat_mask, uint64 flat_code);
+
+	static void calc_FlatMask(const cv::Mat &src, int R, double threshold, cv::Mat &flat_mask, int row_origin = 0);
+
+	static void calc_HammingRow(const uchar *a, const uchar *b, int *dst, int cols, int elem_size);
+
+	static cv::Mat calc_WindowSum(const cv::Mat &dist, int window);
+
+	static Struct_ExecConfig
+	calc_ExecConfig(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp,
+	                const Struct_PGD &struct_dst, bool is_44Int);
+
 	static void write_PGD_uint8(void *ptr, uint64 G);
 
 	static void write_PGD_uint16(void *ptr, uint64 G);
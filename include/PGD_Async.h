@@ -0,0 +1,120 @@
+#ifndef PGD_ASYNC_H
+#define PGD_ASYNC_H
+
+#include <PGD.h>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+/// @file  PGD_Async.h
+/// @brief calc_PGDFilter 的异步接口：提交到库内的执行器，返回future句柄，支持取消与截止时间
+///
+/// 每次提交拆成一个预处理任务和若干计算量有上限的行带任务，行带任务开始前检查取消标志与截止时间，
+/// 被放弃的调用剩余的行带直接跳过，不再占用线程。\n
+/// 执行器的每个线程有自己的任务队列，空闲时从其他线程窃取，批量提交时大小图像的行带交错运行。
+///
+/// @version 1.1
+/// @author 王凌枫
+/// @date
+///
+
+
+/*!
+ * @brief 异步计算
+ * @note 执行器的线程数默认为CPU数，可以通过环境变量 PGD_ASYNC_THREADS 指定（第一次提交前设置）
+ */
+class PGDAsyncClass_ {
+public:
+	/*!
+	 * @brief 任务状态
+	 */
+	enum PGD_TaskState {
+		PGD_Task_Queued = 0,///< 排队中
+		PGD_Task_Running = 1,///< 运行中
+		PGD_Task_Done = 2,///< 全部完成
+		PGD_Task_Cancelled = 3,///< 被取消，输出只有一部分行带有效
+		PGD_Task_Expired = 4,///< 超过截止时间，输出只有一部分行带有效
+		PGD_Task_Failed = 5///< 参数不合法
+	};
+
+	/*!
+	 * @struct Struct_TaskInfo
+	 * @brief 单个任务的统计
+	 */
+	struct Struct_TaskInfo {
+		PGD_TaskState state = PGD_Task_Queued;
+		double queue_seconds = 0;///<从提交到开始运行的时间
+		double run_seconds = 0;///<从开始运行到结束的时间（运行中时为到目前为止）
+		int bands_total = 0;///<行带总数（预处理完成前为0）
+		int bands_done = 0;///<已完成的行带数
+		int bands_skipped = 0;///<因取消或超时而跳过的行带数
+		int64 flat_count = 0;///<走平坦快速路径的像素数（预处理完成前为0）
+		PGDClass_::PGD_MemPolicy mem_policy_work = PGDClass_::PGD_Mem_Plain;///<工作缓冲区实际生效的分配策略（预处理完成前为 PGD_Mem_Plain）
+	};
+
+	/*!
+	 * @struct Struct_AsyncStats
+	 * @brief 执行器的累计统计
+	 */
+	struct Struct_AsyncStats {
+		uint64 n_submitted = 0;
+		uint64 n_done = 0;
+		uint64 n_cancelled = 0;
+		uint64 n_expired = 0;
+		uint64 n_failed = 0;
+		uint64 n_queued = 0;///<当前排队中（尚未开始）的任务数
+		uint64 n_running = 0;///<当前运行中的任务数
+		uint64 bands_run = 0;///<实际计算的行带数
+		uint64 bands_skipped = 0;///<因取消或超时而跳过的行带数
+		uint64 n_steals = 0;///<从其他线程队列中窃取的任务数
+		double queue_seconds = 0;///<所有已开始任务的排队时间之和
+		double run_seconds = 0;///<所有已结束任务的运行时间之和
+	};
+
+	typedef std::function<void(PGD_TaskState, const Struct_TaskInfo &)> PGD_Callback;
+
+	typedef std::function<void(int, PGD_TaskState, const Struct_TaskInfo &)> PGD_BatchCallback;///<第一个参数为图像在批次中的序号
+
+	struct Struct_AsyncJob;
+
+	/*!
+	 * @struct Struct_AsyncHandle
+	 * @brief 异步调用的句柄
+	 * @note future在回调执行之后才就绪，结果写入提交时 Struct_PGD 的 PGD 所指向的内存
+	 */
+	struct Struct_AsyncHandle {
+		std::shared_future<PGD_TaskState> future;
+		std::shared_ptr<Struct_AsyncJob> job;
+
+		void cancel() const;///<请求取消，已经开始的行带会算完，其余行带跳过
+
+		PGD_TaskState wait() const;///<等待结束并返回最终状态
+
+		Struct_TaskInfo get_Info() const;
+	};
+
+	static Struct_AsyncHandle
+	calc_PGDFilterAsync(const cv::Mat &src, const PGDClass_::Struct_PGD &struct_dst, double radius, double radius_2,
+	                    double deadline_seconds = 0, PGD_Callback callback = nullptr);
+
+	static std::vector<Struct_AsyncHandle>
+	calc_PGDFilterBatch(const std::vector<cv::Mat> &srcs, const std::vector<PGDClass_::Struct_PGD> &struct_dsts,
+	                    double radius, double radius_2, double deadline_seconds = 0, PGD_BatchCallback callback = nullptr);
+
+	static Struct_AsyncStats get_AsyncStats();
+
+private:
+	static void calc_Prepare(const std::shared_ptr<Struct_AsyncJob> &job);
+
+	static void calc_PrepareBands(const std::shared_ptr<Struct_AsyncJob> &job);
+
+	static void calc_Band(const std::shared_ptr<Struct_AsyncJob> &job, int band);
+
+	static void calc_Finish(const std::shared_ptr<Struct_AsyncJob> &job, PGD_TaskState state);
+
+	static bool get_ShouldStop(const Struct_AsyncJob &job, PGD_TaskState &state);
+};
+
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef PGD_DETECTOR_H
+#define PGD_DETECTOR_H
+
+#include <PGD.h>
+#include <string>
+#include <vector>
+
+/// @file  PGD_Detector.h
+/// @brief 基于PGD结果的滑动窗口检测打分
+///
+/// 每个窗口划分为若干cell，每个cell对每个通道统计G值的直方图，线性模型对所有直方图加权求和得到窗口得分。
+///
+/// @version 1.1
+/// @author 王凌枫
+/// @date
+///
+
+
+/*!
+ * @brief 滑动窗口检测器
+ * @note 线性模型对直方图的加权和等于cell内每个像素查表得到的权重之和：\n
+ * score = bias + Σ_cell Σ_通道 w[cell][通道][bin(G)]\n
+ * 因此对窗口内的每个cell位置，先逐像素查表得到响应图，再由积分图常数时间得到任意位置的cell和，
+ * 所有窗口位置的总计算量与窗口个数、cell大小无关
+ */
+class PGDDetectorClass_ {
+public:
+	/*!
+	 * @struct Struct_LinearModel
+	 * @brief 某一个窗口大小的线性模型
+	 * @note 权重按 [cell行][cell列][通道][bin] 的顺序排列，共 (win_rows/cell_rows)·(win_cols/cell_cols)·n_channels·2^code_bits 个
+	 */
+	struct Struct_LinearModel {
+		int win_rows = 0;///<窗口行数
+		int win_cols = 0;///<窗口列数
+		int cell_rows = 0;///<cell行数，必须整除窗口行数
+		int cell_cols = 0;///<cell列数，必须整除窗口列数
+		int code_bits = 0;///<直方图的bin数为2^code_bits，G值位数更多时按code_bits位一段异或折叠
+		int n_channels = 0;///<通道数，等于Struct_PGD的n_sample
+		float bias = 0;
+		float threshold = 0;///<得分高于该值的窗口才作为候选
+		std::vector<float> weights;
+	};
+
+	/*!
+	 * @struct Struct_Detection
+	 * @brief 一个检测结果
+	 */
+	struct Struct_Detection {
+		cv::Rect box;
+		float score = 0;
+		int model_index = 0;///<产生该结果的模型（窗口大小）序号
+	};
+
+	/*!
+	 * @struct Struct_DetectResult
+	 * @brief 检测输出：每个模型一张得分图，以及非极大值抑制之后的前k个结果
+	 */
+	struct Struct_DetectResult {
+		std::vector<cv::Mat> score_maps;///<CV_32FC1，第(i,j)个元素对应左上角位于(i·stride, j·stride)的窗口
+		std::vector<Struct_Detection> detections;
+	};
+
+	static Struct_DetectResult
+	calc_Detect(const PGDClass_::Struct_PGD &struct_pgd, const std::vector<Struct_LinearModel> &models,
+	            int stride, int top_k, float nms_iou);
+
+	static bool load_Model(const std::string &path, Struct_LinearModel &model);
+
+private:
+	static cv::Mat calc_CodeBins(const PGDClass_::Struct_PGD &struct_pgd, int code_bits);
+
+	static cv::Mat calc_ScoreMap(const cv::Mat &code_bins, const Struct_LinearModel &model, int stride);
+
+	static std::vector<Struct_Detection>
+	calc_NMS(std::vector<Struct_Detection> &candidates, int top_k, float nms_iou);
+};
+
+
+#endif
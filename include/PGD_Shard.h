@@ -0,0 +1,91 @@
+#ifndef PGD_SHARD_H
+#define PGD_SHARD_H
+
+#include <PGD.h>
+#include <string>
+
+/// @file  PGD_Shard.h
+/// @brief 超大图像的多进程分片计算：按行分片，子进程各自计算并直接写入同一个内存映射的输出文件
+///
+/// 协调进程把图像按行切成若干分片，每个分片连同上下R行的边缘交给一个子进程（fork）计算，
+/// 结果直接写入共享映射（MAP_SHARED）的输出文件中属于该分片的行，分片之间不重叠写。
+/// 每个分片完成并落盘后在清单文件（输出文件名 + ".manifest"）中追加一行，
+/// 中断后使用相同的参数再次调用会跳过清单中已完成的分片；失败的分片单独重试。
+/// @note 仅支持Linux
+///
+/// @version 1.1
+/// @author 王凌枫
+/// @date
+///
+
+
+/*!
+ * @brief 多进程分片计算以及映射文件的读取
+ * @note 输出文件格式：4096字节的文件头（魔数"PGDM"、版本、行数、列数、n_sample、n2_sample、像素类型、
+ * 每行字节数、数据起始位置），随后是行优先的PGD数据，每行字节数为 cols × 每个像素的字节数
+ */
+class PGDShardClass_ {
+public:
+	/*!
+	 * @struct Struct_ShardConfig
+	 * @brief 分片计算的配置
+	 */
+	struct Struct_ShardConfig {
+		int shard_rows = 0;///<每个分片的行数，0表示按子进程数自动划分（每个子进程约4个分片）；flat_threshold 大于0时向上取整为 PGD_FLAT_BAND_ROWS 的倍数
+		int n_workers = 0;///<同时运行的子进程数，0表示CPU数
+		int max_retries = 2;///<每个分片失败后最多重试的次数
+		PGDClass_::Struct_ExecConfig exec_config;///<子进程内的执行配置（不做自动调优），n_threads为0时子进程单线程
+		PGDClass_::PGD_SampleMode sample_mode = PGDClass_::PGD_Sample_Bilinear;
+		double flat_threshold = 0;///<同 Struct_PGD::flat_threshold
+		uint64 flat_code = 0;///<同 Struct_PGD::flat_code
+	};
+
+	/*!
+	 * @struct Struct_ShardReport
+	 * @brief 分片计算的结果统计
+	 */
+	struct Struct_ShardReport {
+		bool ok = false;///<所有分片都已完成
+		int n_shards = 0;///<分片总数
+		int n_resumed = 0;///<清单中已完成、本次跳过的分片数
+		int n_computed = 0;///<本次完成的分片数
+		int n_retries = 0;///<重试的次数
+		int n_failed = 0;///<重试后仍然失败的分片数
+	};
+
+	/*!
+	 * @struct Struct_MappedPGD
+	 * @brief 映射到内存的输出文件，析构时解除映射
+	 */
+	struct Struct_MappedPGD {
+		std::unique_ptr<PGDClass_::Struct_PGD> struct_pgd;///<使用映射内存的PGD结果
+		void *map_ptr = nullptr;
+		size_t map_size = 0;
+
+		Struct_MappedPGD() = default;
+
+		Struct_MappedPGD(const Struct_MappedPGD &) = delete;
+
+		Struct_MappedPGD &operator=(const Struct_MappedPGD &) = delete;
+
+		~Struct_MappedPGD();
+	};
+
+	static Struct_ShardReport
+	calc_PGDFilterSharded(const cv::Mat &src, const std::string &path, PGDClass_::PGD_SampleNums n_sample,
+	                      PGDClass_::PGD_SampleNums n2_sample, double radius, double radius_2,
+	                      const Struct_ShardConfig &config);
+
+	static std::unique_ptr<Struct_MappedPGD> load_MappedPGD(const std::string &path, bool writable = false);
+
+private:
+	static std::unique_ptr<Struct_MappedPGD>
+	def_MappedFile(const std::string &path, int rows, int cols, PGDClass_::PGD_SampleNums n_sample,
+	               PGDClass_::PGD_SampleNums n2_sample);
+
+	static bool calc_Shard(const cv::Mat &src, PGDClass_::Struct_PGD &struct_dst, int row_begin, int row_end,
+	                       double radius, double radius_2, const Struct_ShardConfig &config);
+};
+
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef PGD_TILED_H
+#define PGD_TILED_H
+
+#include <PGD.h>
+#include <vector>
+
+/// @file  PGD_Tiled.h
+/// @brief PGD结果的分块存储：固定大小的方块连续存放，块之间按Morton（Z曲线）顺序排列
+///
+/// 行优先存储时，读取一个窄高区域或旋转框的每一行都要访问新的缓存行（往往还有新的内存页）；
+/// 分块存储时区域内的像素集中在少数几个块里，相邻的块在内存中也大多相邻。
+///
+/// @version 1.1
+/// @author 王凌枫
+/// @date
+///
+
+
+/*!
+ * @brief 分块存储的PGD结果以及与行优先存储之间的转换
+ */
+class PGDTiledClass_ {
+public:
+	/*!
+	 * @struct Struct_TiledPGD
+	 * @brief 分块存储的PGD结果
+	 * @note tiles的每一行是一个块，块内按行优先存放 tile_size × tile_size 个像素，
+	 * 每个像素的字节排列与 Struct_PGD 相同；图像边缘不满的块用0填充
+	 */
+	struct Struct_TiledPGD {
+		int rows = 0;///<行数
+		int cols = 0;///<列数
+		PGDClass_::PGD_SampleNums n_sample = PGDClass_::PGD_SampleNums_SameAs_N_Sample;
+		PGDClass_::PGD_SampleNums n2_sample = PGDClass_::PGD_SampleNums_SameAs_N_Sample;
+		int type = 0;///<像素类型，与 Struct_PGD::PGD 相同
+		size_t elem_size = 0;///<每个像素的字节数
+		int tile_size = 0;///<块的边长（2的幂）
+		int tile_shift = 0;///<log2(tile_size)
+		int tiles_y = 0;///<纵向的块数
+		int tiles_x = 0;///<横向的块数
+		cv::Mat tiles;///<块数据，按Morton顺序每行一个块
+		std::vector<int> tile_slot;///<块坐标（ty·tiles_x + tx）→ 块在tiles中的行号
+
+		bool empty() const { return tiles.empty(); }
+
+		///像素(row, col)的首地址
+		const uchar *ptr(int row, int col) const {
+			int mask = tile_size - 1;
+			int slot = tile_slot[(row >> tile_shift) * tiles_x + (col >> tile_shift)];
+			return tiles.ptr(slot) + (size_t) (((row & mask) << tile_shift) | (col & mask)) * elem_size;
+		}
+
+		///与 Struct_PGD::PGD_read 相同
+		template<typename T>
+		T PGD_read(int row, int col, int channel) const {
+			return reinterpret_cast<const T *>(ptr(row, col))[channel];
+		}
+	};
+
+	/*!
+	 * @struct Struct_RegionSpan
+	 * @brief 区域在同一个块内、同一行上的一段像素，内存连续
+	 */
+	struct Struct_RegionSpan {
+		int row = 0;
+		int col_begin = 0;
+		int col_end = 0;///<不含
+		const uchar *ptr = nullptr;///<像素(row, col_begin)的首地址
+	};
+
+	/*!
+	 * @struct Struct_RegionIterator
+	 * @brief 区域遍历：按块在内存中的顺序依次给出区域覆盖的每一段像素
+	 * @note 区域可以是矩形或旋转框（像素中心落在框内即属于区域），超出图像的部分被裁掉
+	 */
+	struct Struct_RegionIterator {
+		Struct_RegionIterator(const Struct_TiledPGD &_tiled, const cv::Rect &rect);
+
+		Struct_RegionIterator(const Struct_TiledPGD &_tiled, const cv::RotatedRect &box);
+
+		bool next(Struct_RegionSpan &span);///<取下一段，区域遍历完时返回false
+
+		const Struct_TiledPGD *tiled;
+		int row_begin = 0;///<区域的第一行
+		std::vector<int> col_lo;///<区域每一行的列范围 [col_lo, col_hi)
+		std::vector<int> col_hi;
+		std::vector<int> tile_list;///<区域覆盖的块坐标，按块在内存中的顺序排列
+		size_t tile_pos = 0;
+		int next_row = -1;///<当前块内下一个要检查的行，-1表示还没有进入当前块
+
+	private:
+		void init_TileList();
+	};
+
+	static Struct_TiledPGD calc_ToTiled(const PGDClass_::Struct_PGD &struct_pgd, int tile_size = 8);
+
+	static bool calc_ToRowMajor(const Struct_TiledPGD &tiled, PGDClass_::Struct_PGD &struct_dst);
+
+	static cv::Mat calc_ReadRect(const Struct_TiledPGD &tiled, const cv::Rect &rect);
+
+private:
+	static uint64 calc_Morton(uint32_t x, uint32_t y);
+};
+
+
+#endif
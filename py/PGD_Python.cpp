@@ -0,0 +1,342 @@
+
+#define PY_SSIZE_T_CLEAN
+
+#include <Python.h>
+#include <PGD.h>
+#include <string>
+
+/// @file  PGD_Python.cpp
+/// @brief PGD算子的Python扩展模块（模块名 pgd）
+///
+/// 输入通过buffer协议读取（numpy数组、memoryview等均可），不做拷贝；\n
+/// 输出的 PGDResult 对象持有 Struct_PGD，同样通过buffer协议导出，
+/// 因此 numpy.asarray(result) 或 result.array 得到的数组与输出的 cv::Mat 共享内存。\n
+/// 计算期间释放GIL，多个Python线程可以同时处理不同的图像。\n
+/// 参数在释放GIL之前检查；计算中抛出的C++异常（cv::Exception、std::bad_alloc等）在重新获取GIL之后转换为Python异常，
+/// 不会穿过Python的C接口。
+///
+/// @code{.py}
+/// import pgd, cv2
+/// res = pgd.calc_PGDFilter(cv2.imread("data/Kamisato.jpg"), 8, 16, 5.0, 3.0)
+/// codes = res.array          # shape = (rows, cols, n_sample)，不拷贝
+/// @endcode
+
+
+/*!
+ * @struct PGDResultObject
+ * @brief Python侧的结果对象，持有一个 Struct_PGD
+ */
+struct PGDResultObject {
+	PyObject_HEAD
+	PGDClass_::Struct_PGD *pgd;
+	Py_ssize_t shape[3];
+	Py_ssize_t strides[3];
+	const char *format;
+};
+
+static void PGDResult_dealloc(PGDResultObject *self) {
+	delete self->pgd;
+	Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+/*!
+ * @brief buffer协议导出，形状为 (rows, cols, n_sample)
+ * @note 64位的结果在 cv::Mat 中是 CV_64F，但按位运算的性质读写，因此导出为无符号整数
+ */
+static int PGDResult_getbuffer(PGDResultObject *self, Py_buffer *view, int flags) {
+	cv::Mat &mat = self->pgd->PGD;
+	view->obj = (PyObject *) self;
+	Py_INCREF(self);
+	view->buf = mat.data;
+	view->itemsize = (Py_ssize_t) mat.elemSize1();
+	view->len = self->shape[0] * self->shape[1] * self->shape[2] * view->itemsize;
+	view->readonly = 0;
+	view->ndim = 3;
+	view->format = (flags & PyBUF_FORMAT) ? const_cast<char *>(self->format) : nullptr;
+	view->shape = self->shape;
+	view->strides = self->strides;
+	view->suboffsets = nullptr;
+	view->internal = nullptr;
+	return 0;
+}
+
+static PyBufferProcs PGDResult_as_buffer = {
+		(getbufferproc) PGDResult_getbuffer,
+		nullptr
+};
+
+static PyObject *PGDResult_read(PGDResultObject *self, PyObject *args) {
+	int row = 0, col = 0, channel = 0;
+	if (!PyArg_ParseTuple(args, "iii", &row, &col, &channel)) return nullptr;
+	PGDClass_::Struct_PGD &pgd = *self->pgd;
+	if (row < 0 || row >= pgd.rows || col < 0 || col >= pgd.cols || channel < 0 || channel >= pgd.PGD.channels()) {
+		PyErr_SetString(PyExc_IndexError, "PGD_read 越界");
+		return nullptr;
+	}
+	switch (pgd.PGD.elemSize1()) {
+		case 1:
+			return PyLong_FromUnsignedLong(pgd.PGD_read<uint8_t>(row, col, channel));
+		case 2:
+			return PyLong_FromUnsignedLong(pgd.PGD_read<uint16_t>(row, col, channel));
+		case 4:
+			return PyLong_FromUnsignedLong(pgd.PGD_read<uint32_t>(row, col, channel));
+		default:
+			return PyLong_FromUnsignedLongLong(pgd.PGD_read<uint64_t>(row, col, channel));
+	}
+}
+
+///通过numpy.asarray得到共享内存的数组，numpy只在用到时才导入
+static PyObject *PGDResult_array(PGDResultObject *self, void *) {
+	PyObject *numpy = PyImport_ImportModule("numpy");
+	if (numpy == nullptr) return nullptr;
+	PyObject *array = PyObject_CallMethod(numpy, "asarray", "O", (PyObject *) self);
+	Py_DECREF(numpy);
+	return array;
+}
+
+static PyObject *PGDResult_rows(PGDResultObject *self, void *) { return PyLong_FromLong(self->pgd->rows); }
+
+static PyObject *PGDResult_cols(PGDResultObject *self, void *) { return PyLong_FromLong(self->pgd->cols); }
+
+static PyObject *PGDResult_n_sample(PGDResultObject *self, void *) { return PyLong_FromLong(self->pgd->n_sample); }
+
+static PyObject *PGDResult_n2_sample(PGDResultObject *self, void *) { return PyLong_FromLong(self->pgd->n2_sample); }
+
+static PyMethodDef PGDResult_methods[] = {
+		{"read", (PyCFunction) PGDResult_read, METH_VARARGS, "read(row, col, channel)，与 Struct_PGD::PGD_read 相同"},
+		{nullptr}
+};
+
+static PyGetSetDef PGDResult_getset[] = {
+		{"array",     (getter) PGDResult_array,     nullptr, "与输出共享内存的numpy数组，形状为 (rows, cols, n_sample)", nullptr},
+		{"rows",      (getter) PGDResult_rows,      nullptr, "行数",     nullptr},
+		{"cols",      (getter) PGDResult_cols,      nullptr, "列数",     nullptr},
+		{"n_sample",  (getter) PGDResult_n_sample,  nullptr, "【环点】数",  nullptr},
+		{"n2_sample", (getter) PGDResult_n2_sample, nullptr, "【子环点】数", nullptr},
+		{nullptr}
+};
+
+static PyTypeObject PGDResult_Type = {
+		PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+/*!
+ * @brief 把Struct_PGD包装为Python对象，接管其所有权
+ */
+static PyObject *PGDResult_wrap(PGDClass_::Struct_PGD *pgd) {
+	PGDResultObject *self = PyObject_New(PGDResultObject, &PGDResult_Type);
+	if (self == nullptr) {
+		delete pgd;
+		return nullptr;
+	}
+	self->pgd = pgd;
+	self->shape[0] = pgd->rows;
+	self->shape[1] = pgd->cols;
+	self->shape[2] = pgd->PGD.channels();
+	self->strides[0] = (Py_ssize_t) pgd->PGD.step[0];
+	self->strides[1] = (Py_ssize_t) pgd->PGD.step[1];
+	self->strides[2] = (Py_ssize_t) pgd->PGD.elemSize1();
+	switch (pgd->PGD.elemSize1()) {
+		case 1:
+			self->format = "B";
+			break;
+		case 2:
+			self->format = "H";
+			break;
+		case 4:
+			self->format = "I";
+			break;
+		default:
+			self->format = "Q";
+			break;
+	}
+	return (PyObject *) self;
+}
+
+/*!
+ * @brief 把buffer协议的输入包装为 cv::Mat 头部（不拷贝）
+ * @param view 已经获取的buffer
+ * @param mat [输出] 包装后的矩阵
+ * @return 格式不支持时设置Python异常并返回false
+ * @note 支持 (rows, cols) 或 (rows, cols, channels) 形状，行之间可以有间隔，但每行内部必须连续
+ */
+static bool PGD_BufferToMat(const Py_buffer &view, cv::Mat &mat) {
+	if (view.ndim != 2 && view.ndim != 3) {
+		PyErr_SetString(PyExc_ValueError, "输入必须是 (rows, cols) 或 (rows, cols, channels) 形状的数组");
+		return false;
+	}
+	if (view.shape[0] <= 0 || view.shape[1] <= 0 || view.shape[0] > INT_MAX || view.shape[1] > INT_MAX) {
+		PyErr_SetString(PyExc_ValueError, "输入数组的行数和列数必须大于0");
+		return false;
+	}
+	int depth = -1;
+	char code = view.format ? view.format[0] : 'B';
+	if (code == '<' || code == '=' || code == '@') code = view.format[1];
+	switch (code) {
+		case 'B':
+			depth = CV_8U;
+			break;
+		case 'H':
+			depth = CV_16U;
+			break;
+		case 'f':
+			depth = CV_32F;
+			break;
+		case 'd':
+			depth = CV_64F;
+			break;
+		default:
+			PyErr_SetString(PyExc_TypeError, "输入的数据类型只支持 uint8/uint16/float32/float64");
+			return false;
+	}
+	int channels = view.ndim == 3 ? (int) view.shape[2] : 1;
+	if (channels != 1 && channels != 3 && channels != 4) {
+		PyErr_SetString(PyExc_ValueError, "输入的通道数只支持 1/3/4");
+		return false;
+	}
+	if (view.strides[1] != view.itemsize * channels || (view.ndim == 3 && view.strides[2] != view.itemsize) || view.strides[0] <= 0) {
+		PyErr_SetString(PyExc_ValueError, "输入数组每行内部必须是连续的");
+		return false;
+	}
+	mat = cv::Mat((int) view.shape[0], (int) view.shape[1], CV_MAKETYPE(depth, channels), view.buf, (size_t) view.strides[0]);
+	return true;
+}
+
+static bool PGD_CheckSampleNums(int n) {
+	return n == 0 || n == 4 || n == 8 || n == 16 || n == 32 || n == 64;
+}
+
+/*!
+ * @brief 释放GIL执行计算，C++异常在重新获取GIL之后转换为Python异常
+ * @param fun 计算函数，其中不能调用任何Python接口
+ * @return 抛出异常时设置Python异常（内存不足为MemoryError，其他为RuntimeError）并返回false
+ */
+template<typename Fun>
+static bool PGD_RunWithoutGIL(Fun fun) {
+	bool failed = false;
+	bool no_memory = false;
+	std::string error;
+	Py_BEGIN_ALLOW_THREADS
+		try {
+			fun();
+		} catch (const std::bad_alloc &) {
+			failed = no_memory = true;
+		} catch (const std::exception &e) {
+			failed = true;
+			error = e.what();
+		} catch (...) {
+			failed = true;
+			error = "未知的C++异常";
+		}
+	Py_END_ALLOW_THREADS
+	if (!failed) return true;
+	if (no_memory) PyErr_NoMemory();
+	else PyErr_SetString(PyExc_RuntimeError, error.c_str());
+	return false;
+}
+
+static PyObject *PGD_calc_PGDFilter(PyObject *, PyObject *args, PyObject *kwargs) {
+	static const char *kwlist[] = {"src", "n_sample", "n2_sample", "radius", "radius_2", nullptr};
+	PyObject *src_obj = nullptr;
+	int n_sample = 8, n2_sample = 0;
+	double radius = 5, radius_2 = 0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iidd", const_cast<char **>(kwlist),
+	                                 &src_obj, &n_sample, &n2_sample, &radius, &radius_2))
+		return nullptr;
+	if (!PGD_CheckSampleNums(n_sample) || n_sample == 0 || !PGD_CheckSampleNums(n2_sample)) {
+		PyErr_SetString(PyExc_ValueError, "n_sample/n2_sample 只能是 4/8/16/32/64（n2_sample 为0时与n_sample相同）");
+		return nullptr;
+	}
+	if (!(radius > 0) || !(radius_2 >= 0)) {
+		PyErr_SetString(PyExc_ValueError, "radius 必须大于0，radius_2 不能小于0（为0时与radius相同）");
+		return nullptr;
+	}
+	Py_buffer view;
+	if (PyObject_GetBuffer(src_obj, &view, PyBUF_STRIDES | PyBUF_FORMAT) != 0) return nullptr;
+	cv::Mat src;
+	if (!PGD_BufferToMat(view, src)) {
+		PyBuffer_Release(&view);
+		return nullptr;
+	}
+	PGDClass_::Struct_PGD *pgd = nullptr;
+	bool ok = PGD_RunWithoutGIL([&] {
+		std::unique_ptr<PGDClass_::Struct_PGD> result(new PGDClass_::Struct_PGD(src.rows, src.cols,
+		                                                                        (PGDClass_::PGD_SampleNums) n_sample,
+		                                                                        (PGDClass_::PGD_SampleNums) n2_sample));
+		PGDClass_::calc_PGDFilter(src, *result, radius, radius_2);
+		pgd = result.release();
+	});
+	PyBuffer_Release(&view);
+	return ok ? PGDResult_wrap(pgd) : nullptr;
+}
+
+static PyObject *PGD_calc_PGDFilter44_Int(PyObject *, PyObject *args, PyObject *kwargs) {
+	static const char *kwlist[] = {"src", "radius", "radius_2", nullptr};
+	PyObject *src_obj = nullptr;
+	int radius = 5, radius_2 = 0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ii", const_cast<char **>(kwlist), &src_obj, &radius, &radius_2))
+		return nullptr;
+	if (radius <= 0 || radius_2 < 0) {
+		PyErr_SetString(PyExc_ValueError, "radius 必须大于0，radius_2 不能小于0（为0时与radius相同）");
+		return nullptr;
+	}
+	Py_buffer view;
+	if (PyObject_GetBuffer(src_obj, &view, PyBUF_STRIDES | PyBUF_FORMAT) != 0) return nullptr;
+	cv::Mat src;
+	if (!PGD_BufferToMat(view, src)) {
+		PyBuffer_Release(&view);
+		return nullptr;
+	}
+	if (src.channels() != 1) {
+		PyBuffer_Release(&view);
+		PyErr_SetString(PyExc_ValueError, "calc_PGDFilter44_Int 的输入必须是灰度图像（单通道）");
+		return nullptr;
+	}
+	PGDClass_::Struct_PGD *pgd = nullptr;
+	bool ok = PGD_RunWithoutGIL([&] {
+		std::unique_ptr<PGDClass_::Struct_PGD> result(
+				new PGDClass_::Struct_PGD(src.rows, src.cols, PGDClass_::PGD_SampleNums_4, PGDClass_::PGD_SampleNums_4));
+		PGDClass_::calc_PGDFilter44_Int(src, *result, radius, radius_2);
+		pgd = result.release();
+	});
+	PyBuffer_Release(&view);
+	return ok ? PGDResult_wrap(pgd) : nullptr;
+}
+
+static PyMethodDef PGD_methods[] = {
+		{"calc_PGDFilter",       (PyCFunction) (void (*)(void)) PGD_calc_PGDFilter,       METH_VARARGS | METH_KEYWORDS,
+				"calc_PGDFilter(src, n_sample=8, n2_sample=0, radius=5.0, radius_2=0.0) -> PGDResult"},
+		{"calc_PGDFilter44_Int", (PyCFunction) (void (*)(void)) PGD_calc_PGDFilter44_Int, METH_VARARGS | METH_KEYWORDS,
+				"calc_PGDFilter44_Int(src, radius=5, radius_2=0) -> PGDResult，src 需为灰度图像"},
+		{nullptr}
+};
+
+static PyModuleDef PGD_module = {
+		PyModuleDef_HEAD_INIT,
+		"pgd",
+		"PGD算子的Python接口",
+		-1,
+		PGD_methods
+};
+
+PyMODINIT_FUNC PyInit_pgd(void) {
+	PGDResult_Type.tp_name = "pgd.PGDResult";
+	PGDResult_Type.tp_basicsize = sizeof(PGDResultObject);
+	PGDResult_Type.tp_dealloc = (destructor) PGDResult_dealloc;
+	PGDResult_Type.tp_flags = Py_TPFLAGS_DEFAULT;
+	PGDResult_Type.tp_doc = "Struct_PGD 的包装，支持buffer协议";
+	PGDResult_Type.tp_methods = PGDResult_methods;
+	PGDResult_Type.tp_getset = PGDResult_getset;
+	PGDResult_Type.tp_as_buffer = &PGDResult_as_buffer;
+	if (PyType_Ready(&PGDResult_Type) < 0) return nullptr;
+
+	PyObject *module = PyModule_Create(&PGD_module);
+	if (module == nullptr) return nullptr;
+	Py_INCREF(&PGDResult_Type);
+	if (PyModule_AddObject(module, "PGDResult", (PyObject *) &PGDResult_Type) < 0) {
+		Py_DECREF(&PGDResult_Type);
+		Py_DECREF(module);
+		return nullptr;
+	}
+	return module;
+}
@@ -1,10 +1,14 @@
 
 #include <PGD.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 
 #define PI 3.1415926535897932384626433832795028841971
+#define PGD_FLAT_MIN_GAP 16 ///<平坦快速路径：短于该长度的平坦间隙并入相邻的计算列段
 
 
-int id = 0;
+std::atomic<int> id(0);//调试用的对象编号，异步接口会在多个线程中同时构造
 
 
 /*!
@@ -20,34 +24,95 @@ PGDClass_::Struct_PGD PGDClass_::calc_PGDFilter(const cv::_InputArray &_src,
                                                 Struct_PGD &_struct_dst,
                                                 double radius,
                                                 double radius_2) {
-	int n_sample = _struct_dst.n_sample;
-	int n2_sample = _struct_dst.n2_sample;
+	calc_PGDFilterChecked(_src, _struct_dst, radius, radius_2);
+	return _struct_dst;
+}
+
+/*!
+ * @brief calc_PGDFilter() 的主体，返回是否计算成功
+ * @return 输入为空、与输出大小不同或预处理不支持该输入时返回false，输出内存未被写入
+ */
+bool PGDClass_::calc_PGDFilterChecked(const cv::_InputArray &_src, Struct_PGD &_struct_dst, double radius, double radius_2) {
 	cv::Mat temp_dst = _struct_dst.PGD;
+	if (_src.empty() || _src.rows() != temp_dst.rows || _src.cols() != temp_dst.cols) {
+		printf("出现异常，calc_PGDFilter 的输入图像为空或与输出大小不同\n");
+		return false;
+	}
+
+	///①~③预处理，计算【环点】偏移量以及【子环点】的插值权重
+	cv::Mat src_double;
+	cv::Mat flat_mask;
+	std::unique_ptr<Struct_N4InterpList> struct_n4Interp =
+			calc_PrepareN4(_src.getMat(), _struct_dst, radius, radius_2, src_double, &flat_mask, &_struct_dst.mem_policy_work);
+	if (!struct_n4Interp) return false;
+
+	///④遍历全图
+	//按行带并行，遍历策略、行带高度和线程数由自动调优决定（或由 _struct_dst.exec_config 指定）
+	Struct_ExecConfig config = calc_ExecConfig(src_double, temp_dst, *struct_n4Interp, _struct_dst, false);
+	calc_ParallelTraverse(src_double, temp_dst, *struct_n4Interp, config, false, flat_mask, _struct_dst.flat_code);
+	_struct_dst.exec_config = config;
+	_struct_dst.flat_count = flat_mask.empty() ? 0 : cv::countNonZero(flat_mask);
+	return true;
+}
+
+/*!
+ * @brief calc_PGDFilter() 遍历之前的准备工作：预处理输入图像，计算【环点】偏移量以及【子环点】的插值权重
+ * @param src 输入的矩阵
+ * @param struct_cfg 算子配置结构体，读取其中的 n_sample、n2_sample、sample_mode、flat_threshold、
+ * mem_policy 以及 exec_config（决定工作缓冲区并行写入时的行带划分）
+ * @param radius 【环点】半径大小（浮点数）
+ * @param radius_2 【环点】周围的【子环点】计算范围，为0时等于radius
+ * @param src_double [输出] 填充过的double图像（区域均值采样时为未归一化像素值的积分图），大小为 (rows + 2·pad) × (cols + 2·pad)
+ * @param flat_mask [输出] 不为空且 struct_cfg.flat_threshold 大于0时输出平坦掩码，否则置为空矩阵
+ * @param mem_applied [输出] 不为空时写入src_double实际生效的分配策略
+ * @param flat_origin src的第0行在整幅图像中的行号（分片计算时不为0），见 calc_FlatMask
+ * @return 插值列表，其中的pad为填充的大小；输入类型不支持时为nullptr
+ */
+std::unique_ptr<PGDClass_::Struct_N4InterpList>
+PGDClass_::calc_PrepareN4(const cv::Mat &src, const Struct_PGD &struct_cfg, double radius, double radius_2, cv::Mat &src_double,
+                          cv::Mat *flat_mask, PGD_MemPolicy *mem_applied, int flat_origin) {
+	int n_sample = struct_cfg.n_sample;
+	int n2_sample = struct_cfg.n2_sample;
 	//这个是采样时候以中心点为圆心，radius为半径的采样圆的最小外接正四边形框的尺寸
 	//采样正四边形矩形框后，还有一个步骤就是对采样圆上的点进行二次采样，二次采样的大小也需要再次指定
 	//因此需要对原图像的边缘进行填充，填充的大小由radius和radius_2决定
 	if (radius_2 == 0) radius_2 = radius;
 	int R = (int) ceil(radius + radius_2);
-	int l_size = 1 + 2 * R;
 	if (n2_sample == PGD_SampleNums_SameAs_N_Sample) n2_sample = n_sample;
+	//区域均值采样时，每个【子环点】取周围 (2h+1)×(2h+1) 方框的均值，填充还需要再加上方框的大小以及积分图多出的1行1列
+	int box_half = 0;
+	if (struct_cfg.sample_mode == PGD_Sample_BoxIntegral) {
+		box_half = calc_BoxHalfSize(n2_sample, radius_2);
+		R += box_half + 1;
+	}
 
-	int rows = _src.rows();
-	int cols = _src.cols();
-	cv::Mat src_gray;
-
-	///①通道数量转换
-	//如果是三通道，使用灰度图像
-	if (_src.channels() == 3) {
-		cv::cvtColor(_src, src_gray, cv::COLOR_BGR2GRAY, 0);
-	} else src_gray = _src.getMat();
-	///一律使用double类型，同时对边缘进行填充
-	cv::Mat src_double;
-	src_gray.convertTo(src_double, CV_64FC1);
-	src_double = src_double / 255;
-	///这里姑且使用边缘复制法，安全起见再多加1个像素点
-	cv::copyMakeBorder(src_double, src_double, R,
-	                   R, R,
-	                   R, cv::BORDER_REPLICATE);
+	///①预处理：通道数量转换、double类型转换、归一化、边缘填充一次完成
+	//原先是 cvtColor → convertTo → /255 → copyMakeBorder 四次全图遍历，现在只读一次原图
+	//区域均值采样不归一化：整数像素值的积分图与方框之和都是精确的整数，相等的方框在比较时严格相等，
+	//不会因为缩放的舍入误差随位置不同而得到不同的大小关系（只比较大小，不需要再缩放回去）
+	double scale = struct_cfg.sample_mode == PGD_Sample_BoxIntegral ? 1.0 : 1.0 / 255;
+	//遍历时读取的缓冲区按分配策略预先分配（区域均值采样时是积分图，积分之前的图像只是临时的）
+	PGD_MemPolicy applied = PGD_Mem_Plain;
+	PGD_MemPolicy src_policy = struct_cfg.sample_mode == PGD_Sample_BoxIntegral ? PGD_Mem_Plain : struct_cfg.mem_policy;
+	src_double = def_PolicyMat(src.rows + 2 * R, src.cols + 2 * R, CV_64FC1, src_policy, struct_cfg.exec_config, R, applied);
+	calc_FusedPreprocess(src, src_double, R, scale);
+	if (src_double.empty()) return nullptr;
+	//平坦掩码要用积分之前的像素值，阈值按[0,1]的像素值给出，未归一化时按比例放大
+	if (flat_mask != nullptr) {
+		flat_mask->release();
+		double threshold_scale = 255 * scale;
+		if (struct_cfg.flat_threshold > 0)
+			calc_FlatMask(src_double, R, struct_cfg.flat_threshold * threshold_scale * threshold_scale, *flat_mask, flat_origin);
+	}
+	if (struct_cfg.sample_mode == PGD_Sample_BoxIntegral) {
+		//积分图比原图多出第0行和第0列（全为0），去掉之后与填充过的图像大小相同，
+		//位置(i,j)的值为左上角到(i,j)（含）的矩形区域之和
+		cv::Mat src_integral = def_PolicyMat(src_double.rows + 1, src_double.cols + 1, CV_64FC1, struct_cfg.mem_policy,
+		                                     struct_cfg.exec_config, R, applied);
+		cv::integral(src_double, src_integral, CV_64F);
+		src_double = src_integral(cv::Range(1, src_integral.rows), cv::Range(1, src_integral.cols));
+	}
+	if (mem_applied != nullptr) *mem_applied = applied;
 
 
 	/*               ①→
@@ -73,13 +138,12 @@ PGDClass_::Struct_PGD PGDClass_::calc_PGDFilter(const cv::_InputArray &_src,
 	///③计算每一个采样点的二次插值需要的参考权重（这里是N4方法）
 	//初始化，把结果放到一个表里
 	//返回的是Struct_N4InterpList
-	Struct_N4InterpList struct_n4Interp(std::move(struct_sampleOffset), n2_sample, radius_2);
-	calc_N4_QuadraticInterpolationInit(struct_n4Interp);
-
-	///④遍历全图
-	//这里使用速度稍微快一些的`.ptr<Type>(i)[j]`方法，而且比较安全
-	calc_N4PGD_Traverse(src_double, temp_dst, struct_n4Interp);
-	return _struct_dst;
+	std::unique_ptr<Struct_N4InterpList> struct_n4Interp(new Struct_N4InterpList(std::move(struct_sampleOffset), n2_sample, radius_2));
+	if (struct_cfg.sample_mode == PGD_Sample_BoxIntegral)
+		calc_Box_IntegralInit(*struct_n4Interp, box_half);
+	else
+		calc_N4_QuadraticInterpolationInit(*struct_n4Interp);
+	return struct_n4Interp;
 }
 
 /*!
@@ -91,7 +155,7 @@ PGDClass_::Struct_PGD PGDClass_::calc_PGDFilter(const cv::_InputArray &_src,
  * @return 返回值是一个 cv::Mat 类型的数据
  * @note ① 针对固化参数进行优化的函数 n1和n2都是4！
  * ② radius 和 radius_2 都是整数
- * ③ 必须是使用灰度图像
+ * ③ 建议在函数外部转换为灰度图像；彩色图像会在预处理中按BGR转换
  */
 cv::Mat PGDClass_::calc_PGDFilter44_Int(const cv::_InputArray &_src, Struct_PGD &_struct_dst, int radius, int radius_2) {
 	const int n_sample = 4;
@@ -106,13 +170,22 @@ cv::Mat PGDClass_::calc_PGDFilter44_Int(const cv::_InputArray &_src, Struct_PGD
 	int rows = _src.rows();
 	int cols = _src.cols();
 	cv::Mat temp_dst = _struct_dst.PGD;
+	if (_src.empty() || rows != temp_dst.rows || cols != temp_dst.cols) {
+		printf("出现异常，calc_PGDFilter44_Int 的输入图像为空或与输出大小不同\n");
+		return cv::Mat();
+	}
 
 	cv::Mat src_double;
 
-	///①通道数量转换 已被忽略，放到函数外面执行
+	///①通道数量转换 已被忽略，放到函数外面执行（如果传入的仍是彩色图像，预处理中会一并转换）
 
 	///这里姑且使用边缘复制法
-	cv::copyMakeBorder(_src, src_double, R, R, R, R, cv::BORDER_REPLICATE);
+	src_double = def_PolicyMat(rows + 2 * R, cols + 2 * R, CV_64FC1, _struct_dst.mem_policy, _struct_dst.exec_config, R,
+	                           _struct_dst.mem_policy_work);
+	calc_FusedPreprocess(_src.getMat(), src_double, R, 1.0);
+	if (src_double.empty()) return src_double;
+	cv::Mat flat_mask;
+	if (_struct_dst.flat_threshold > 0) calc_FlatMask(src_double, R, _struct_dst.flat_threshold, flat_mask);
 
 	/*               ①→
 	 *                   ↘
@@ -141,11 +214,193 @@ cv::Mat PGDClass_::calc_PGDFilter44_Int(const cv::_InputArray &_src, Struct_PGD
 	calc_N4_QuadraticInterpolationInit(struct_n4Interp);
 
 	///④遍历全图
-	//这里使用速度稍微快一些的`.ptr<Type>(i)[j]`方法，而且比较安全
-	calc_44IntPGD_Traverse(src_double, temp_dst, struct_n4Interp);
+	//按行带并行，执行配置同 calc_PGDFilter
+	Struct_ExecConfig config = calc_ExecConfig(src_double, temp_dst, struct_n4Interp, _struct_dst, true);
+	calc_ParallelTraverse(src_double, temp_dst, struct_n4Interp, config, true, flat_mask, _struct_dst.flat_code);
+	_struct_dst.exec_config = config;
+	_struct_dst.flat_count = flat_mask.empty() ? 0 : cv::countNonZero(flat_mask);
 	return src_double;
 }
 
+/*!
+ * @brief calc_PGDFilter_Raw()函数，底层接口，输入输出都是调用者持有的内存
+ * @param src_data 输入图像首地址
+ * @param width 输入图像的列数
+ * @param height 输入图像的行数
+ * @param src_stride 输入图像每行的字节数
+ * @param src_type 输入像素类型
+ * @param dst_data 输出内存首地址，大小至少为 height × dst_stride
+ * @param dst_stride 输出每行的字节数，不能小于 calc_DstRowBytes() 的结果
+ * @param n_sample 【环点】个数
+ * @param n2_sample 【子环点】个数
+ * @param radius 【环点】半径大小
+ * @param radius_2 【子环点】计算范围
+ * @return 参数不合法、像素类型不支持或预处理失败时返回false（此时输出内存未被写入）
+ * @note 输入和输出都只是用 cv::Mat 的头部包装，不做任何拷贝，只有内部的填充缓冲区需要分配
+ */
+bool PGDClass_::calc_PGDFilter_Raw(const void *src_data, int width, int height, size_t src_stride, PGD_PixelType src_type,
+                                   void *dst_data, size_t dst_stride,
+                                   PGD_SampleNums n_sample, PGD_SampleNums n2_sample, double radius, double radius_2) {
+	if (n2_sample == PGD_SampleNums_SameAs_N_Sample) n2_sample = n_sample;
+	//PGD_PixelType 可能由整数强制转换而来，不在枚举中的类型（如CV_8UC2）的步长检查仍可能通过
+	switch (src_type) {
+		case PGD_PixelType_U8C1:
+		case PGD_PixelType_U8C3:
+		case PGD_PixelType_U8C4:
+		case PGD_PixelType_U16C1:
+		case PGD_PixelType_F32C1:
+		case PGD_PixelType_F64C1:
+			break;
+		default:
+			printf("出现异常，calc_PGDFilter_Raw 不支持该像素类型（%d）\n", (int) src_type);
+			return false;
+	}
+	size_t src_row_bytes = (size_t) width * CV_ELEM_SIZE(src_type);
+	if (src_data == nullptr || dst_data == nullptr || width <= 0 || height <= 0 ||
+	    src_stride < src_row_bytes || dst_stride < calc_DstRowBytes(width, n_sample, n2_sample)) {
+		printf("出现异常，calc_PGDFilter_Raw 的输入参数不合法\n");
+		return false;
+	}
+	//cv::Mat 的外部数据构造函数只接收非const指针，这里只读不写
+	cv::Mat src(height, width, src_type, const_cast<void *>(src_data), src_stride);
+	Struct_PGD struct_dst(height, width, n_sample, n2_sample, dst_data, dst_stride);
+	return calc_PGDFilterChecked(src, struct_dst, radius, radius_2);
+}
+
+/*!
+ * @overload
+ * @brief calc_PGDFilter_Raw()函数，输出内存由回调函数分配
+ * @param allocator 分配输出内存的回调函数
+ * @param user_data 原样传给回调函数
+ * @param dst_stride [输出] 回调函数给出的每行字节数
+ * @return 输出内存首地址，分配失败或参数不合法时返回nullptr（回调已分配的内存由调用者负责释放）
+ */
+void *PGDClass_::calc_PGDFilter_Raw(const void *src_data, int width, int height, size_t src_stride, PGD_PixelType src_type,
+                                    PGD_Allocator allocator, void *user_data, size_t *dst_stride,
+                                    PGD_SampleNums n_sample, PGD_SampleNums n2_sample, double radius, double radius_2) {
+	if (allocator == nullptr || dst_stride == nullptr || width <= 0 || height <= 0) {
+		printf("出现异常，calc_PGDFilter_Raw 的输入参数不合法\n");
+		return nullptr;
+	}
+	if (n2_sample == PGD_SampleNums_SameAs_N_Sample) n2_sample = n_sample;
+	size_t row_bytes = calc_DstRowBytes(width, n_sample, n2_sample);
+	*dst_stride = row_bytes;
+	void *dst_data = allocator(height, row_bytes, dst_stride, user_data);
+	if (dst_data == nullptr) return nullptr;
+	if (!calc_PGDFilter_Raw(src_data, width, height, src_stride, src_type, dst_data, *dst_stride,
+	                        n_sample, n2_sample, radius, radius_2))
+		return nullptr;
+	return dst_data;
+}
+
+/*!
+ * @brief 计算输出每一行最少需要的字节数，供底层接口的调用者分配内存
+ * @param cols 列数
+ * @param n_sample 【环点】个数
+ * @param n2_sample 【子环点】个数
+ */
+size_t PGDClass_::calc_DstRowBytes(int cols, PGD_SampleNums n_sample, PGD_SampleNums n2_sample) {
+	return (size_t) cols * CV_ELEM_SIZE(def_DstType(n_sample, n2_sample));
+}
+
+/*!
+ * @brief BGR三个分量转换为灰度值，与 cv::COLOR_BGR2GRAY 的结果一致
+ * @note 整数类型使用14位定点系数并四舍五入，浮点类型直接使用浮点系数
+ */
+static inline int calc_GrayValue(const uchar *px) {
+	return (px[0] * 1868 + px[1] * 9617 + px[2] * 4899 + (1 << 13)) >> 14;
+}
+
+static inline int calc_GrayValue(const ushort *px) {
+	return (px[0] * 1868 + px[1] * 9617 + px[2] * 4899 + (1 << 13)) >> 14;
+}
+
+static inline float calc_GrayValue(const float *px) {
+	return px[0] * 0.114f + px[1] * 0.587f + px[2] * 0.299f;
+}
+
+static inline double calc_GrayValue(const double *px) {
+	return px[0] * 0.114 + px[1] * 0.587 + px[2] * 0.299;
+}
+
+/*!
+ * @brief 单行的灰度转换 + 类型转换 + 缩放，结果写入填充缓冲区对应行的有效区域
+ * @tparam T 输入图像的数据类型
+ * @param src_row 输入图像的行指针
+ * @param dst_row 填充缓冲区的行指针（已经偏移了R列）
+ * @param cols 输入图像的列数
+ * @param channels 输入图像的通道数，1为灰度，3/4按BGR(A)处理
+ * @param scale 缩放系数
+ */
+template<typename T>
+static void calc_FusedPreprocessRow(const uchar *src_row, double *dst_row, int cols, int channels, double scale) {
+	const T *ptr = reinterpret_cast<const T *>(src_row);
+	if (channels == 1) {
+		for (int j = 0; j < cols; ++j) dst_row[j] = ptr[j] * scale;
+	} else {
+		for (int j = 0; j < cols; ++j, ptr += channels) dst_row[j] = calc_GrayValue(ptr) * scale;
+	}
+}
+
+/*!
+ * @brief 融合的预处理函数：通道转换、double类型转换、缩放和边缘复制填充在一次遍历中完成
+ * @param src 输入图像，1通道（灰度）或 3/4通道（BGR/BGRA）；8U/16U/32F/64F 直接逐行转换，
+ * 其他深度（8S/16S/32S等）先用 convertTo 转成double再按 64F 处理
+ * @param dst 输出的填充缓冲区，大小为 (rows + 2R) × (cols + 2R)，类型为 CV_64FC1
+ * @param R 边缘填充的大小
+ * @param scale 缩放系数，直接乘在类型转换上，不再需要单独的归一化遍历
+ * @note 灰度转换与 cv::COLOR_BGR2GRAY 的结果一致，缩放也与原先的 `/ 255` 一致，因此输出的G值与原来逐位相同
+ * （G值只取决于大小关系，但是插值结果相等时的舍入误差与缩放有关，为了保持结果不变这里仍然保留缩放）\n
+ * 按输出行并行，每一行只依赖输入图像的一行（上下填充区域重复读取边缘行），
+ * 左右两侧的填充直接复制该行首尾的值，相当于 cv::BORDER_REPLICATE\n
+ * 输入为空或通道数不支持时打印错误并把dst置为空矩阵，调用者据此在遍历之前返回
+ */
+void PGDClass_::calc_FusedPreprocess(const cv::Mat &_src, cv::Mat &dst, int R, double scale) {
+	cv::Mat src = _src;
+	int rows = src.rows;
+	int cols = src.cols;
+	int channels = src.channels();
+	void (*ptr_RowFun)(const uchar *, double *, int, int, double) = nullptr;
+	switch (src.depth()) {
+		case CV_8U:
+			ptr_RowFun = &calc_FusedPreprocessRow<uchar>;
+			break;
+		case CV_16U:
+			ptr_RowFun = &calc_FusedPreprocessRow<ushort>;
+			break;
+		case CV_32F:
+			ptr_RowFun = &calc_FusedPreprocessRow<float>;
+			break;
+		case CV_64F:
+			ptr_RowFun = &calc_FusedPreprocessRow<double>;
+			break;
+		default:
+			//其他深度没有专门的行函数，先整体转换为double（原先的 convertTo 路径）
+			if (!src.empty()) src.convertTo(src, CV_64F);
+			ptr_RowFun = &calc_FusedPreprocessRow<double>;
+			break;
+	}
+	if (src.empty() || (channels != 1 && channels != 3 && channels != 4)) {
+		printf("出现异常，预处理不支持该输入类型（深度 %d，通道数 %d）\n", _src.depth(), channels);
+		dst.release();
+		return;
+	}
+
+	dst.create(rows + 2 * R, cols + 2 * R, CV_64FC1);
+	cv::parallel_for_(cv::Range(0, dst.rows), [&](const cv::Range &range) {
+		for (int i = range.start; i < range.end; ++i) {
+			//填充区域的行对应原图的第一行或最后一行
+			int src_i = std::min(std::max(i - R, 0), rows - 1);
+			double *dst_row = dst.ptr<double>(i);
+			ptr_RowFun(src.ptr(src_i), dst_row + R, cols, channels, scale);
+			for (int j = 0; j < R; ++j) {
+				dst_row[j] = dst_row[R];
+				dst_row[R + cols + j] = dst_row[R + cols - 1];
+			}
+		}
+	});
+}
+
 /*!
 	 * @brief calc_N4PGD_Traverse 通过N4方法插值遍历全图
 	 * @param src 输入图像（必须是单通道）
@@ -184,12 +439,10 @@ void PGDClass_::calc_N4PGD_Traverse(const cv::Mat &src, cv::Mat &PGD_Data, const
 
 
 	int channel_size = ceil((float) n2_sample / 8.0f);//每个通道的数据占用的字节数，位数不满8个则取8个位（1字节）
-	double r1 = struct_n4Interp.r1;
-	double r2 = struct_n4Interp.r2;
 	//输入的图像一般是拓展过的图像，因此可以直接从初始的（0，0）开始遍历
 	int rows = src.rows;
 	int cols = src.cols;
-	int R = (int) ceil(r1 + r2); // R 是偏移量，[0. R-1]以及[rows-R,rows-1]行都不是，列同理
+	int R = struct_n4Interp.pad; // R 是偏移量，[0. R-1]以及[rows-R,rows-1]行都不是，列同理（一般为ceil(r1 + r2)）
 	int len_win = 1 + 2 * R; //滑框窗口大小
 	//这里使用了行指针，因此没有必要检查Mat变量是否连续。
 	//并且这里一定是double类型的数据，数据类型在前面需要做好规范措施
@@ -285,7 +538,7 @@ void PGDClass_::calc_N4PGD_Traverse(const cv::Mat &src, cv::Mat &PGD_Data, const
 				InterpValue[n2_sample] = InterpValue[0];//调制最后一位，规避if判断是否为最后一位
 				for (int l = 0; l < n2_sample; ++l) {
 					if (InterpValue[l] > InterpValue[l + 1])
-						temp_G |= 1 << l;
+						temp_G |= (int64) 1 << l;
 				}
 				void *temp_ptr = (PGD_Data.data + PGD_Data.step[0] * ii + PGD_Data.step[1] * jj + kk);
 #if __PGD_DEBUG2
@@ -428,6 +681,270 @@ void PGDClass_::calc_44IntPGD_Traverse(const cv::Mat &src, cv::Mat &PGD_Data, co
 	}
 }
 
+/*!
+ * @brief 按行带并行遍历全图
+ * @param src 填充过的输入图像
+ * @param PGD_Data 输出图像
+ * @param struct_n4Interp 输入的带权重的参数
+ * @param config 执行配置
+ * @param is_44Int 是否为固化参数的44Int方法
+ * @param flat_mask 平坦掩码（与输出同大小），为空时不使用快速路径
+ * @param flat_code 平坦像素每个通道写入的G值
+ * @note 每个行带只是输入和输出的ROI（输入多带上下各R行），遍历函数本身不需要任何修改。\n
+ * 分块策略下每个任务是一个二维块，同样只是ROI（输入多带上下左右各R行/列），块按行优先顺序分配\n
+ * config.n_threads 大于0时通过 parallel_for_ 的 nstripes 限制并发：任务按顺序分成 n_threads 组，
+ * 同时运行的线程不超过 n_threads 个。不修改OpenCV的全局线程数，多个线程同时调用时互不影响
+ */
+void PGDClass_::calc_ParallelTraverse(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp,
+                                      const Struct_ExecConfig &config, bool is_44Int, const cv::Mat &flat_mask,
+                                      uint64 flat_code) {
+	int R = struct_n4Interp.pad;
+	int rows = PGD_Data.rows;
+
+	if (config.strategy == PGD_Traverse_Tiled2D) {
+		int cols = PGD_Data.cols;
+		int tile_rows = 0, tile_cols = 0;
+		calc_TileSize(config, rows, cols, R, struct_n4Interp.n2_sample, PGD_Data.elemSize(), tile_rows, tile_cols);
+		int n_tiles_y = (rows + tile_rows - 1) / tile_rows;
+		int n_tiles_x = (cols + tile_cols - 1) / tile_cols;
+		int n_tiles = n_tiles_y * n_tiles_x;
+		cv::parallel_for_(cv::Range(0, n_tiles), [&](const cv::Range &range) {
+			for (int t = range.start; t < range.end; ++t) {
+				int row_begin = (t / n_tiles_x) * tile_rows;
+				int col_begin = (t % n_tiles_x) * tile_cols;
+				int row_end = std::min(rows, row_begin + tile_rows);
+				int col_end = std::min(cols, col_begin + tile_cols);
+				cv::Mat src_tile = src(cv::Range(row_begin, row_end + 2 * R), cv::Range(col_begin, col_end + 2 * R));
+				cv::Mat dst_tile = PGD_Data(cv::Range(row_begin, row_end), cv::Range(col_begin, col_end));
+				cv::Mat mask_tile = flat_mask.empty() ? cv::Mat() : flat_mask(cv::Range(row_begin, row_end), cv::Range(col_begin, col_end));
+				calc_TraverseMasked(src_tile, dst_tile, struct_n4Interp, config.strategy, is_44Int, mask_tile, flat_code);
+			}
+		}, config.n_threads > 0 ? std::min(n_tiles, config.n_threads) : n_tiles);
+		return;
+	}
+
+	int band_rows = calc_BandRows(config, rows);
+	int n_bands = (rows + band_rows - 1) / band_rows;
+
+	cv::parallel_for_(cv::Range(0, n_bands), [&](const cv::Range &range) {
+		for (int b = range.start; b < range.end; ++b) {
+			int row_begin = b * band_rows;
+			int row_end = std::min(rows, row_begin + band_rows);
+			cv::Mat src_band = src.rowRange(row_begin, row_end + 2 * R);
+			cv::Mat dst_band = PGD_Data.rowRange(row_begin, row_end);
+			cv::Mat mask_band = flat_mask.empty() ? cv::Mat() : flat_mask.rowRange(row_begin, row_end);
+			calc_TraverseMasked(src_band, dst_band, struct_n4Interp, config.strategy, is_44Int, mask_band, flat_code);
+		}
+	}, config.n_threads > 0 ? std::min(n_bands, config.n_threads) : n_bands);
+}
+
+/*!
+ * @brief 分块策略的块大小：块的输入（含R宽的边缘）、输出以及逐行计算的插值缓冲区放入缓存预算
+ * @param config 执行配置，band_rows / tile_cols 大于0时直接使用
+ * @param rows 输出行数
+ * @param cols 输出列数
+ * @param R 边缘宽度
+ * @param n2_sample 【子环点】数，决定逐行计算的插值缓冲区大小
+ * @param dst_elem_size 输出每个像素的字节数
+ * @param tile_rows [输出] 块高
+ * @param tile_cols [输出] 块宽
+ * @note 先取近似正方形的块（边缘占比最小），图像较窄时块宽取整行，再用剩余的预算确定块高。
+ * 块边长至少为 max(16, 2R)，预算过小时以边长下限为准
+ */
+void PGDClass_::calc_TileSize(const Struct_ExecConfig &config, int rows, int cols, int R, int n2_sample,
+                              size_t dst_elem_size, int &tile_rows, int &tile_cols) {
+	double budget = (config.cache_kb > 0 ? config.cache_kb : 512) * 1024.0;
+	int min_side = std::max(16, 2 * R);
+	///每个块的字节数：输入 (h+2R)(w+2R) 个double，输出 h·w 个像素，插值缓冲区 (n2_sample+2)·w 个double
+	auto tile_bytes = [&](double h, double w) {
+		return (h + 2 * R) * (w + 2 * R) * sizeof(double) + h * w * dst_elem_size + (n2_sample + 2) * w * sizeof(double);
+	};
+
+	tile_cols = config.tile_cols;
+	if (tile_cols <= 0) {
+		int side = std::max(min_side, (int) sqrt(budget / sizeof(double)) - 2 * R);
+		while (side > min_side && tile_bytes(side, side) > budget) --side;
+		tile_cols = side;
+	}
+	tile_cols = std::max(1, std::min(cols, tile_cols));
+
+	tile_rows = config.band_rows;
+	if (tile_rows <= 0) {
+		double per_row = tile_bytes(1, tile_cols) - tile_bytes(0, tile_cols);
+		tile_rows = std::max(min_side, (int) ((budget - tile_bytes(0, tile_cols)) / per_row));
+	}
+	tile_rows = std::max(1, std::min(rows, tile_rows));
+}
+
+/*!
+ * @brief 按指定的策略遍历（单线程），输入输出可以是行带或分块的ROI
+ * @note 分块策略在块内使用逐行计算
+ * @param src 填充过的输入图像，比输出多出上下左右各pad行/列
+ * @param PGD_Data 输出图像
+ * @param struct_n4Interp 输入的带权重的参数
+ * @param strategy 遍历策略
+ * @param is_44Int 是否为固化参数的44Int方法
+ */
+void PGDClass_::calc_Traverse(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp,
+                              PGD_TraverseStrategy strategy, bool is_44Int) {
+	if (is_44Int) {
+		if (strategy != PGD_Traverse_PixelWise)
+			calc_44IntPGD_TraverseRow(src, PGD_Data, struct_n4Interp);
+		else
+			calc_44IntPGD_Traverse(src, PGD_Data, struct_n4Interp);
+	} else {
+		if (strategy != PGD_Traverse_PixelWise)
+			calc_N4PGD_TraverseRow(src, PGD_Data, struct_n4Interp);
+		else
+			calc_N4PGD_Traverse(src, PGD_Data, struct_n4Interp);
+	}
+}
+
+/*!
+ * @brief 带平坦掩码的遍历：平坦像素直接写入flat_code，其余像素按原方法计算
+ * @param src 填充过的输入图像（ROI）
+ * @param PGD_Data 输出图像（ROI）
+ * @param struct_n4Interp 输入的带权重的参数
+ * @param strategy 遍历策略
+ * @param is_44Int 是否为固化参数的44Int方法
+ * @param flat_mask 与PGD_Data同大小的平坦掩码，为空时等同于 calc_Traverse
+ * @param flat_code 平坦像素每个通道写入的G值
+ * @note 不含平坦像素的连续多行一次遍历；含平坦像素的行只遍历非平坦的列段（同样是ROI），
+ * 短于 PGD_FLAT_MIN_GAP 的平坦间隙并入相邻列段一起计算（避免过碎的调用），之后再被flat_code覆盖
+ */
+void PGDClass_::calc_TraverseMasked(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp,
+                                    PGD_TraverseStrategy strategy, bool is_44Int, const cv::Mat &flat_mask, uint64 flat_code) {
+	if (flat_mask.empty()) {
+		calc_Traverse(src, PGD_Data, struct_n4Interp, strategy, is_44Int);
+		return;
+	}
+	int R = struct_n4Interp.pad;
+	int rows = PGD_Data.rows;
+	int cols = PGD_Data.cols;
+	size_t elem_size = PGD_Data.elemSize();
+
+	//一个平坦像素的全部字节
+	std::vector<uchar> flat_pixel(elem_size);
+	size_t channel_bytes = PGD_Data.elemSize1();
+	for (int k = 0; k < PGD_Data.channels(); ++k) {
+		void *ptr = &flat_pixel[k * channel_bytes];
+		switch (channel_bytes) {
+			case 1:
+				write_PGD_uint8(ptr, flat_code);
+				break;
+			case 2:
+				write_PGD_uint16(ptr, flat_code);
+				break;
+			case 4:
+				write_PGD_uint32(ptr, flat_code);
+				break;
+			default:
+				write_PGD_uint64(ptr, flat_code);
+				break;
+		}
+	}
+
+	int block_begin = 0;//尚未遍历的、不含平坦像素的连续行的起点
+	auto flush_Block = [&](int block_end) {
+		if (block_end <= block_begin) return;
+		cv::Mat dst_block = PGD_Data.rowRange(block_begin, block_end);
+		calc_Traverse(src.rowRange(block_begin, block_end + 2 * R), dst_block, struct_n4Interp, strategy, is_44Int);
+	};
+	for (int i = 0; i < rows; ++i) {
+		const uchar *mask_row = flat_mask.ptr(i);
+		if (memchr(mask_row, 1, (size_t) cols) == nullptr) continue;
+		flush_Block(i);
+		block_begin = i + 1;
+
+		int j = 0;
+		while (j < cols) {
+			while (j < cols && mask_row[j]) ++j;
+			if (j >= cols) break;
+			int run_begin = j, run_end = j;
+			while (j < cols) {
+				if (!mask_row[j]) {
+					run_end = ++j;
+					continue;
+				}
+				int gap_begin = j;
+				while (j < cols && mask_row[j]) ++j;
+				if (j - gap_begin >= PGD_FLAT_MIN_GAP || j >= cols) break;
+			}
+			cv::Mat dst_run = PGD_Data(cv::Range(i, i + 1), cv::Range(run_begin, run_end));
+			calc_Traverse(src(cv::Range(i, i + 1 + 2 * R), cv::Range(run_begin, run_end + 2 * R)), dst_run,
+			              struct_n4Interp, strategy, is_44Int);
+		}
+		uchar *dst_row = PGD_Data.ptr(i);
+		for (j = 0; j < cols; ++j)
+			if (mask_row[j]) memcpy(dst_row + j * elem_size, flat_pixel.data(), elem_size);
+	}
+	flush_Block(rows);
+}
+
+/*!
+ * @brief 平坦掩码：每个像素 (2R+1)×(2R+1) 邻域的方差小于阈值时为1
+ * @param src 填充过的输入图像，大小为 (rows + 2R) × (cols + 2R)
+ * @param R 填充的大小
+ * @param threshold 方差阈值
+ * @param flat_mask [输出] CV_8UC1 类型的掩码，大小为 rows × cols
+ * @param row_origin 掩码第0行在整幅图像中的行号，行带按整幅图像的行号对齐
+ * @note 按 PGD_FLAT_BAND_ROWS 行的行带并行，每个行带维护各列 2R+1 行的和与平方和，逐行下移时加入新行、减去旧行，
+ * 再沿行方向滑动求窗口和，每个像素的计算量与半径无关。\n
+ * 行带的划分固定（不随OpenCV的默认分块和线程数变化），并且从整幅图像的第0行算起（不随分片的位置变化），
+ * 滑动求和的舍入因此只取决于图像，掩码在各次调用之间一致
+ */
+void PGDClass_::calc_FlatMask(const cv::Mat &src, int R, double threshold, cv::Mat &flat_mask, int row_origin) {
+	int rows = src.rows - 2 * R;
+	int cols = src.cols - 2 * R;
+	int len_win = 2 * R + 1;
+	double inv_n = 1.0 / ((double) len_win * len_win);
+	flat_mask.create(rows, cols, CV_8UC1);
+	//第一个完整行带之前的部分自成一个行带
+	int first = (PGD_FLAT_BAND_ROWS - row_origin % PGD_FLAT_BAND_ROWS) % PGD_FLAT_BAND_ROWS;
+	first = std::min(first, rows);
+	int n_bands = (first > 0) + (rows - first + PGD_FLAT_BAND_ROWS - 1) / PGD_FLAT_BAND_ROWS;
+	cv::parallel_for_(cv::Range(0, n_bands), [&](const cv::Range &band_range) {
+		std::vector<double> col_sum((size_t) src.cols), col_sq((size_t) src.cols);
+		for (int b = band_range.start; b < band_range.end; ++b) {
+			int band_begin = first > 0 ? (b == 0 ? 0 : first + (b - 1) * PGD_FLAT_BAND_ROWS) : b * PGD_FLAT_BAND_ROWS;
+			int band_end = first > 0 && b == 0 ? first : std::min(rows, band_begin + PGD_FLAT_BAND_ROWS);
+			const cv::Range range(band_begin, band_end);
+			std::fill(col_sum.begin(), col_sum.end(), 0.0);
+			std::fill(col_sq.begin(), col_sq.end(), 0.0);
+			for (int t = 0; t < len_win; ++t) {
+				const double *src_row = src.ptr<double>(range.start + t);
+				for (int c = 0; c < src.cols; ++c) {
+					col_sum[c] += src_row[c];
+					col_sq[c] += src_row[c] * src_row[c];
+				}
+			}
+			for (int i = range.start; i < range.end; ++i) {
+				uchar *mask_row = flat_mask.ptr(i);
+				double sum = 0, sq = 0;
+				for (int c = 0; c < len_win - 1; ++c) {
+					sum += col_sum[c];
+					sq += col_sq[c];
+				}
+				for (int j = 0; j < cols; ++j) {
+					sum += col_sum[j + len_win - 1];
+					sq += col_sq[j + len_win - 1];
+					double mean = sum * inv_n;
+					mask_row[j] = (uchar) (sq * inv_n - mean * mean < threshold);
+					sum -= col_sum[j];
+					sq -= col_sq[j];
+				}
+				if (i + 1 == range.end) break;
+				const double *row_out = src.ptr<double>(i);
+				const double *row_in = src.ptr<double>(i + len_win);
+				for (int c = 0; c < src.cols; ++c) {
+					col_sum[c] += row_in[c] - row_out[c];
+					col_sq[c] += row_in[c] * row_in[c] - row_out[c] * row_out[c];
+				}
+			}
+		}
+	}, n_bands);
+}
+
 void PGDClass_::write_PGD_uint8(void *ptr, uint64 G) {
 	*reinterpret_cast<uint8_t *>(ptr) = (uint8_t) G;
 }
@@ -450,24 +967,14 @@ void PGDClass_::write_PGD_uint64(void *ptr, uint64 G) {
  *  @param cols 矩阵的列数
  *  @param n_sample 【环点数】决定了通道个数
  *  @param n2_sample 【子环点数】 决定了每个通道占用的字节个数
+ *  @param mem_policy 分配策略，按默认的执行配置划分行带
+ *  @param mem_applied [输出] 实际生效的分配策略
  *  @note 其实可以定义一个n_bit位的数来帮助减少内存的占用量，但是这不符合CPU的运算逻辑，并且进过调研后发现会极大影响运算速度，因此弃用
  */
-cv::Mat PGDClass_::def_DstMat(int rows, int cols, PGD_SampleNums n_sample, PGD_SampleNums n2_sample) {
-	int level_0 = 8 * sizeof(char);
-	int level_1 = 8 * sizeof(short);
-	int level_2 = 8 * sizeof(int);
-	int level_3 = 8 * sizeof(long);
+cv::Mat PGDClass_::def_DstMat(int rows, int cols, PGD_SampleNums n_sample, PGD_SampleNums n2_sample, PGD_MemPolicy mem_policy,
+                              PGD_MemPolicy &mem_applied) {
 	int print_B = 0;
-	cv::Mat dst;
-	//n2_sample决定了每个通道占用的字节个数
-	if (n2_sample <= level_0)
-		dst = cv::Mat(rows, cols, CV_8UC(n_sample));
-	else if (n2_sample <= level_1)
-		dst = cv::Mat(rows, cols, CV_16UC(n_sample));
-	else if (n2_sample <= level_2)
-		dst = cv::Mat(rows, cols, CV_32SC(n_sample)); // 32位有符号（位操作时可以忽略符号位）
-	else if (n2_sample <= level_3)
-		dst = cv::Mat(rows, cols, CV_64FC(n_sample)); //虽然是double，但是读写的时候使用的是64位数的性质
+	cv::Mat dst = def_PolicyMat(rows, cols, def_DstType(n_sample, n2_sample), mem_policy, Struct_ExecConfig(), 0, mem_applied);
 	printf("——————————————————————————\n");
 	printf("①数据的step[0]为 %d————每行占用 %d 字节\n", (int) dst.step[0], (int) dst.step[0]);
 	printf("②数据的step[1]为 %d————每个元素占用 %d 字节\n", (int) dst.step[1], (int) dst.step[1]);
@@ -486,6 +993,7 @@ cv::Mat PGDClass_::def_DstMat(int rows, int cols, PGD_SampleNums n_sample, PGD_S
 	} else if ((memory_size /= 1024) < 1024) {
 		std::cout << "数据变量占用内存为： " << memory_size << " GB" << std::endl;
 	}
+	printf("⑤内存分配策略为 %s（请求的策略为 %s）\n", get_MemPolicyName(mem_applied), get_MemPolicyName(calc_MemPolicy(mem_policy)));
 
 
 	printf("——————————————————————————\n");
@@ -493,6 +1001,27 @@ cv::Mat PGDClass_::def_DstMat(int rows, int cols, PGD_SampleNums n_sample, PGD_S
 
 }
 
+/*!
+ * @brief 私有函数，根据【环点数】和【子环点数】确定输出矩阵的类型
+ *  @param n_sample 【环点数】决定了通道个数
+ *  @param n2_sample 【子环点数】 决定了每个通道占用的字节个数，PGD_SampleNums_SameAs_N_Sample 时与n_sample相同
+ */
+int PGDClass_::def_DstType(PGD_SampleNums n_sample, PGD_SampleNums n2_sample) {
+	int level_0 = 8 * sizeof(char);
+	int level_1 = 8 * sizeof(short);
+	int level_2 = 8 * sizeof(int);
+	if (n2_sample == PGD_SampleNums_SameAs_N_Sample) n2_sample = n_sample;
+	//n2_sample决定了每个通道占用的字节个数
+	if (n2_sample <= level_0)
+		return CV_8UC(n_sample);
+	else if (n2_sample <= level_1)
+		return CV_16UC(n_sample);
+	else if (n2_sample <= level_2)
+		return CV_32SC(n_sample); // 32位有符号（位操作时可以忽略符号位）
+	else
+		return CV_64FC(n_sample); //虽然是double，但是读写的时候使用的是64位数的性质
+}
+
 /*!
  * @brief 计算在目标区域中邻域的n_sample个采样点相对于中心点的偏移量
  *  @param n_sample 采样点个数，有几个采样点就有几个需要计算的偏移量
@@ -636,6 +1165,66 @@ void PGDClass_::calc_N4_QuadraticInterpolationInit(Struct_N4InterpList &struct_n
 }
 
 
+/*!
+ * @brief 区域均值采样的方框半径
+ * @param n2_sample 【子环点】数
+ * @param radius_2 【子环点】半径
+ * @return 方框半径h，方框大小为 (2h+1)×(2h+1)
+ * @note 方框边长约等于相邻两个【子环点】之间的弦长 2·r2·sin(π/n2)，随radius_2增大，相邻方框基本不重叠
+ */
+int PGDClass_::calc_BoxHalfSize(int n2_sample, double radius_2) {
+	return std::max(0, (int) round(radius_2 * sin(PI / n2_sample)));
+}
+
+/*!
+ * @brief 区域均值采样的初始化函数，复用N4插值的列表
+ * @details 每个【子环点】取四舍五入后的整数位置为中心、(2h+1)×(2h+1) 方框内的均值。
+ * 在积分图 I（I(y,x) 为左上角到 (y,x) 的矩形之和）上，方框之和只需要四个角点：\n
+ * sum = I(y1,x1) - I(y1,x2) + I(y2,x2) - I(y2,x1)，其中 x1 = cx-h-1，x2 = cx+h，y1 = cy-h-1，y2 = cy+h\n
+ * 这正好是N4插值的四个参考点（左上、右上、右下、左下）加权求和的形式，权重为 ±1，
+ * 因此遍历函数不需要修改，只需要把输入换成积分图，每个【子环点】的计算量与半径无关。\n
+ * 所有方框大小相同，比较方框之和与比较均值的结果一样，因此不再除以 (2h+1)²；
+ * 输入为整数像素值（calc_PrepareN4 中不归一化）时，积分图和方框之和都是精确的整数，相等的方框严格相等
+ * @param struct_n4Interp N4插值法初始信息结构体的引用
+ * @param box_half 方框半径h
+ * @note 会把 struct_n4Interp.pad 增加 h+1，调用者需要按增加后的大小填充图像
+ */
+void PGDClass_::calc_Box_IntegralInit(Struct_N4InterpList &struct_n4Interp, int box_half) {
+	int n_sample = struct_n4Interp.n_sample;
+	int n2_sample = struct_n4Interp.n2_sample;
+	double radius_2 = struct_n4Interp.r2;
+	double step_theta = 2 * PI / n_sample;
+	double step_phi = 2 * PI / n2_sample;
+	const double weight = 1.0;
+
+	for (int i = 0; i < n_sample; ++i) {
+		double x_i = struct_n4Interp.arr_SampleOffsetX[i];
+		double y_i = struct_n4Interp.arr_SampleOffsetY[i];
+		double theta = i * step_theta;
+		for (int j = 0; j < n2_sample; ++j) {
+			//【子环点】位置与 calc_N4_QuadraticInterpolationInit 相同
+			double phi = theta + j * step_phi;
+			short cx = (short) round(x_i + radius_2 * sin(phi + theta));
+			short cy = (short) round(y_i - radius_2 * cos(phi + theta));
+			short x1 = (short) (cx - box_half - 1), x2 = (short) (cx + box_half);
+			short y1 = (short) (cy - box_half - 1), y2 = (short) (cy + box_half);
+			struct_n4Interp.arr_InterpOffsetX[i][j][0] = x1;//左上↖
+			struct_n4Interp.arr_InterpOffsetY[i][j][0] = y1;
+			struct_n4Interp.arr_InterpOffsetX[i][j][1] = x2;//右上↗
+			struct_n4Interp.arr_InterpOffsetY[i][j][1] = y1;
+			struct_n4Interp.arr_InterpOffsetX[i][j][2] = x2;//右下↘
+			struct_n4Interp.arr_InterpOffsetY[i][j][2] = y2;
+			struct_n4Interp.arr_InterpOffsetX[i][j][3] = x1;//左下↙
+			struct_n4Interp.arr_InterpOffsetY[i][j][3] = y2;
+			struct_n4Interp.arr_InterpWeight[i][j][0] = weight;
+			struct_n4Interp.arr_InterpWeight[i][j][1] = -weight;
+			struct_n4Interp.arr_InterpWeight[i][j][2] = weight;
+			struct_n4Interp.arr_InterpWeight[i][j][3] = -weight;
+		}
+	}
+	struct_n4Interp.pad += box_half + 1;
+}
+
 /*!
  * @overload
  * @brief Struct_SampleOffsetList构造函数
@@ -737,6 +1326,7 @@ PGDClass_::Struct_N4InterpList::Struct_N4InterpList(Struct_SampleOffsetList &&st
 #endif
 	this->n2_sample = _n2_sample;
 	this->r2 = _r2;
+	this->pad = (int) ceil(this->r1 + _r2);
 
 	//根据n_sample的个数以及n2_sample的个数初始化数组
 	this->arr_InterpWeight = new double **[(unsigned long) this->n_sample];
@@ -784,13 +1374,35 @@ PGDClass_::Struct_N4InterpList::~Struct_N4InterpList() {
 	* @param _cols 列数
 	* @param _n_sample 【环点】个数
 	* @param _n2_sample 【子环点】个数
+	* @param _mem_policy 输出内存与之后计算中工作缓冲区的分配策略，实际生效的策略见 mem_policy_dst
+*/
+PGDClass_::Struct_PGD::Struct_PGD(int _rows, int _cols, PGD_SampleNums _n_sample, PGD_SampleNums _n2_sample,
+                                  PGD_MemPolicy _mem_policy) {
+	n_sample = _n_sample;
+	n2_sample = _n2_sample;
+	mem_policy = _mem_policy;
+	PGD = def_DstMat(_rows, _cols, _n_sample, _n2_sample, mem_policy, mem_policy_dst);
+	rows = _rows;
+	cols = _cols;
+	data_start = PGD.data;
+	step_0 = PGD.step[0];
+	step_1 = PGD.step[1];
+}
+
+/*!
+	* @overload
+	* @brief Struct_PGD构造函数，输出结果直接写入调用者提供的内存（例如共享内存、锁页内存）
+	* @param _data 外部内存首地址，生命周期由调用者负责
+	* @param _step 每行的字节数
 */
-PGDClass_::Struct_PGD::Struct_PGD(int _rows, int _cols, PGD_SampleNums _n_sample, PGD_SampleNums _n2_sample) {
+PGDClass_::Struct_PGD::Struct_PGD(int _rows, int _cols, PGD_SampleNums _n_sample, PGD_SampleNums _n2_sample,
+                                  void *_data, size_t _step) {
 	n_sample = _n_sample;
 	n2_sample = _n2_sample;
-	PGD = def_DstMat(_rows, _cols, _n_sample, _n2_sample);
+	PGD = cv::Mat(_rows, _cols, def_DstType(_n_sample, _n2_sample), _data, _step);
 	rows = _rows;
 	cols = _cols;
+	data_start = PGD.data;
 	step_0 = PGD.step[0];
 	step_1 = PGD.step[1];
 }
@@ -0,0 +1,491 @@
+
+#include <PGD_Async.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @file  PGD_Async.cpp
+/// @brief 异步计算：库内的执行器、任务拆分、取消与截止时间、统计
+
+#define PGD_ASYNC_BAND_COST (1 << 24) ///<未指定行带高度时，每个行带任务的计算量上限（像素数 × 【环点】数 × 【子环点】数），决定取消与窃取的粒度
+
+typedef std::chrono::steady_clock PGD_Clock;
+
+
+//=======================================================================
+//	执行器
+//=======================================================================
+
+static thread_local int current_worker = -1;///<当前线程在执行器中的编号，-1表示不是执行器线程
+static std::atomic<uint64> n_steals(0);
+
+/*!
+ * @struct Struct_WorkerQueue
+ * @brief 单个工作线程的任务双端队列：本线程从尾部取（后进先出，数据还在缓存中），其他线程从头部窃取
+ */
+struct Struct_WorkerQueue {
+	std::mutex mutex;
+	std::deque<std::function<void()>> tasks;
+};
+
+/*!
+ * @struct Struct_Executor
+ * @brief 固定线程数、带工作窃取的线程池
+ * @note 执行器线程提交的任务（行带）放入自己的队列，外部线程提交的任务（预处理）放入公共队列按提交顺序执行；
+ * 取任务的顺序为：自己的队列尾部 → 公共队列头部 → 依次窃取其他线程队列的头部。析构时执行完所有剩余的任务再退出
+ */
+struct Struct_Executor {
+	std::vector<std::unique_ptr<Struct_WorkerQueue>> queues;
+	Struct_WorkerQueue inject_queue;///<外部线程提交的任务
+	std::vector<std::thread> workers;
+	std::mutex sleep_mutex;
+	std::condition_variable cond;
+	std::atomic<int> n_pending{0};///<所有队列中的任务数
+	bool stop = false;
+
+	explicit Struct_Executor(int n_threads) {
+		for (int t = 0; t < n_threads; ++t) queues.emplace_back(new Struct_WorkerQueue);
+		for (int t = 0; t < n_threads; ++t) workers.emplace_back([this, t] { run(t); });
+	}
+
+	~Struct_Executor() {
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+			stop = true;
+		}
+		cond.notify_all();
+		for (std::thread &worker : workers) worker.join();
+	}
+
+	void push(std::vector<std::function<void()>> &tasks) {
+		Struct_WorkerQueue &queue = current_worker >= 0 ? *queues[current_worker] : inject_queue;
+		{
+			//要么全部放入，要么一个都不放入（内存不足时撤回已放入的部分再抛出），调用者据此判断是否需要自己收尾
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			size_t n_before = queue.tasks.size();
+			try {
+				for (std::function<void()> &task : tasks) queue.tasks.push_back(std::move(task));
+			} catch (...) {
+				while (queue.tasks.size() > n_before) queue.tasks.pop_back();
+				throw;
+			}
+		}
+		n_pending += (int) tasks.size();
+		//先加计数再加锁通知，等待中的线程在锁内检查计数，不会错过
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+		}
+		if (tasks.size() == 1) cond.notify_one();
+		else cond.notify_all();
+	}
+
+	bool pop(int self, std::function<void()> &task) {
+		{
+			Struct_WorkerQueue &own = *queues[self];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty()) {
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(inject_queue.mutex);
+			if (!inject_queue.tasks.empty()) {
+				task = std::move(inject_queue.tasks.front());
+				inject_queue.tasks.pop_front();
+				return true;
+			}
+		}
+		int n_queues = (int) queues.size();
+		for (int k = 1; k < n_queues; ++k) {
+			Struct_WorkerQueue &victim = *queues[(self + k) % n_queues];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty()) {
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				++n_steals;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run(int self) {
+		current_worker = self;
+		for (;;) {
+			std::function<void()> task;
+			if (pop(self, task)) {
+				--n_pending;
+				//任务自己会捕获异常并结束对应的异步调用，这里只是防止异常逃出线程导致整个进程终止
+				try {
+					task();
+				} catch (...) {
+					printf("出现异常，执行器中的任务抛出了未处理的异常\n");
+				}
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(sleep_mutex);
+			cond.wait(lock, [this] { return stop || n_pending > 0; });
+			if (stop && n_pending == 0) return;
+		}
+	}
+};
+
+///执行器（第一次使用时创建）
+static Struct_Executor &get_Executor() {
+	static Struct_Executor executor([] {
+		const char *env = std::getenv("PGD_ASYNC_THREADS");
+		int n_threads = env != nullptr ? atoi(env) : 0;
+		return n_threads > 0 ? n_threads : std::max(1, cv::getNumberOfCPUs());
+	}());
+	return executor;
+}
+
+static std::mutex stats_mutex;
+static PGDAsyncClass_::Struct_AsyncStats async_stats;
+
+static double get_Seconds(PGD_Clock::time_point begin, PGD_Clock::time_point end) {
+	return std::chrono::duration<double>(end - begin).count();
+}
+
+
+//=======================================================================
+//	任务
+//=======================================================================
+
+/*!
+ * @struct Struct_AsyncJob
+ * @brief 一次异步调用的全部状态，由句柄和执行器中的任务共同持有
+ */
+struct PGDAsyncClass_::Struct_AsyncJob {
+	cv::Mat src;
+	PGDClass_::Struct_PGD struct_dst;///<与调用者的 Struct_PGD 共享输出内存
+	double radius = 0;
+	double radius_2 = 0;
+	PGD_Callback callback;
+	std::promise<PGD_TaskState> promise;
+
+	PGD_Clock::time_point submit_time, start_time, deadline;
+	bool has_deadline = false;
+	std::atomic<bool> cancel_requested{false};
+	std::atomic<int> state{PGD_Task_Queued};
+	std::atomic<int> stop_state{0};///<第一个被跳过的行带记录的原因（取消或超时）
+
+	std::unique_ptr<PGDClass_::Struct_N4InterpList> struct_n4Interp;
+	cv::Mat src_double;
+	cv::Mat flat_mask;
+	int64 flat_count = 0;
+	PGDClass_::PGD_MemPolicy mem_policy_work = PGDClass_::PGD_Mem_Plain;
+	int band_rows = 0;
+	std::atomic<int> bands_total{0}, bands_left{0}, bands_done{0}, bands_skipped{0};
+
+	std::mutex mutex;///<保护 start_time、耗时、flat_count 与 mem_policy_work
+	double queue_seconds = 0;
+	double run_seconds = 0;
+
+	explicit Struct_AsyncJob(const PGDClass_::Struct_PGD &_struct_dst) : struct_dst(_struct_dst) {}
+};
+
+/*!
+ * @brief 异步版本的 calc_PGDFilter
+ * @param src 输入的矩阵，数据在任务结束前不能被修改
+ * @param struct_dst 算子配置结构体，输出写入其 PGD 所指向的内存（结构体本身会被复制）
+ * @param radius 【环点】半径大小（浮点数）
+ * @param radius_2 【环点】周围的【子环点】计算范围，为0时等于radius
+ * @param deadline_seconds 截止时间（从提交开始计算的秒数），0表示不限制；超时后剩余的行带被放弃
+ * @param callback 结束时在执行器线程中调用，可以为空
+ * @return 句柄
+ * @note 执行配置取 struct_dst.exec_config（不做自动调优），行带高度为0时按 PGD_ASYNC_BAND_COST 限制每个行带的计算量
+ */
+PGDAsyncClass_::Struct_AsyncHandle
+PGDAsyncClass_::calc_PGDFilterAsync(const cv::Mat &src, const PGDClass_::Struct_PGD &struct_dst, double radius, double radius_2,
+                                    double deadline_seconds, PGD_Callback callback) {
+	std::shared_ptr<Struct_AsyncJob> job = std::make_shared<Struct_AsyncJob>(struct_dst);
+	job->src = src;
+	job->radius = radius;
+	job->radius_2 = radius_2;
+	job->callback = std::move(callback);
+	job->submit_time = PGD_Clock::now();
+	if (deadline_seconds > 0) {
+		job->has_deadline = true;
+		job->deadline = job->submit_time + std::chrono::duration_cast<PGD_Clock::duration>(std::chrono::duration<double>(deadline_seconds));
+	}
+
+	Struct_AsyncHandle handle;
+	handle.future = job->promise.get_future().share();
+	handle.job = job;
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		++async_stats.n_submitted;
+		++async_stats.n_queued;
+	}
+	std::vector<std::function<void()>> tasks;
+	tasks.emplace_back([job] { calc_Prepare(job); });
+	get_Executor().push(tasks);
+	return handle;
+}
+
+/*!
+ * @brief 批量异步计算：所有图像的行带任务在同一个执行器中交错运行
+ * @param srcs 输入的矩阵
+ * @param struct_dsts 与srcs一一对应的算子配置结构体，输出写入各自的 PGD 所指向的内存
+ * @param radius 【环点】半径大小（浮点数）
+ * @param radius_2 【环点】周围的【子环点】计算范围，为0时等于radius
+ * @param deadline_seconds 每张图像的截止时间（从提交开始计算的秒数），0表示不限制
+ * @param callback 每张图像结束时立即调用（参数为图像的序号），可以为空
+ * @return 与srcs一一对应的句柄，参数个数不一致时为空
+ * @note 每张图像拆成计算量有上限的行带任务，预处理任务所在的线程把行带放入自己的队列，
+ * 空闲的线程从其他线程窃取，因此小图像不必等大图像算完，大图像也不会只由一个线程计算。
+ * 按像素数从大到小提交，减少批次末尾只剩一张大图像在算的情况
+ */
+std::vector<PGDAsyncClass_::Struct_AsyncHandle>
+PGDAsyncClass_::calc_PGDFilterBatch(const std::vector<cv::Mat> &srcs, const std::vector<PGDClass_::Struct_PGD> &struct_dsts,
+                                    double radius, double radius_2, double deadline_seconds, PGD_BatchCallback callback) {
+	std::vector<Struct_AsyncHandle> handles;
+	if (srcs.size() != struct_dsts.size()) {
+		printf("出现异常，calc_PGDFilterBatch 的输入与输出个数不同\n");
+		return handles;
+	}
+	std::vector<int> order(srcs.size());
+	for (size_t i = 0; i < order.size(); ++i) order[i] = (int) i;
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return srcs[a].total() > srcs[b].total(); });
+
+	handles.resize(srcs.size());
+	for (int index : order) {
+		PGD_Callback image_callback = nullptr;
+		if (callback)
+			image_callback = [callback, index](PGD_TaskState state, const Struct_TaskInfo &info) { callback(index, state, info); };
+		handles[index] = calc_PGDFilterAsync(srcs[index], struct_dsts[index], radius, radius_2, deadline_seconds, image_callback);
+	}
+	return handles;
+}
+
+/*!
+ * @brief 是否应当放弃剩余的工作
+ * @param job 任务
+ * @param state [输出] 放弃的原因
+ * @note 某个行带计算失败后，其余的行带也不再计算
+ */
+bool PGDAsyncClass_::get_ShouldStop(const Struct_AsyncJob &job, PGD_TaskState &state) {
+	if (job.stop_state.load(std::memory_order_relaxed) == PGD_Task_Failed) {
+		state = PGD_Task_Failed;
+		return true;
+	}
+	if (job.cancel_requested.load(std::memory_order_relaxed)) {
+		state = PGD_Task_Cancelled;
+		return true;
+	}
+	if (job.has_deadline && PGD_Clock::now() >= job.deadline) {
+		state = PGD_Task_Expired;
+		return true;
+	}
+	return false;
+}
+
+/*!
+ * @brief 预处理任务：检查输入，填充输入、计算插值权重，然后把全部行带任务放入执行器
+ * @note 预处理中的异常（OpenCV的错误、内存不足）被捕获并以 PGD_Task_Failed 结束；
+ * 行带任务全部放入执行器之后，收尾由最后一个行带负责
+ */
+void PGDAsyncClass_::calc_Prepare(const std::shared_ptr<Struct_AsyncJob> &job) {
+	{
+		std::lock_guard<std::mutex> lock(job->mutex);
+		job->start_time = PGD_Clock::now();
+		job->queue_seconds = get_Seconds(job->submit_time, job->start_time);
+	}
+	job->state = PGD_Task_Running;
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		--async_stats.n_queued;
+		++async_stats.n_running;
+		async_stats.queue_seconds += job->queue_seconds;
+	}
+
+	PGD_TaskState stop_state;
+	if (get_ShouldStop(*job, stop_state)) {
+		calc_Finish(job, stop_state);
+		return;
+	}
+	const PGDClass_::Struct_PGD &struct_dst = job->struct_dst;
+	const cv::Mat &src = job->src;
+	if (src.empty() || src.dims != 2 || src.rows != struct_dst.rows || src.cols != struct_dst.cols) {
+		printf("出现异常，calc_PGDFilterAsync 的输入图像为空或与输出大小不同\n");
+		calc_Finish(job, PGD_Task_Failed);
+		return;
+	}
+	if (src.channels() != 1 && src.channels() != 3 && src.channels() != 4) {
+		printf("出现异常，calc_PGDFilterAsync 不支持该输入类型（深度 %d，通道数 %d）\n", src.depth(), src.channels());
+		calc_Finish(job, PGD_Task_Failed);
+		return;
+	}
+	if (struct_dst.PGD.empty() || struct_dst.PGD.rows != struct_dst.rows || struct_dst.PGD.cols != struct_dst.cols) {
+		printf("出现异常，calc_PGDFilterAsync 的输出内存为空或与输出大小不同\n");
+		calc_Finish(job, PGD_Task_Failed);
+		return;
+	}
+	try {
+		calc_PrepareBands(job);
+	} catch (const std::exception &e) {
+		printf("出现异常，异步预处理失败：%s\n", e.what());
+		calc_Finish(job, PGD_Task_Failed);
+	} catch (...) {
+		printf("出现异常，异步预处理失败\n");
+		calc_Finish(job, PGD_Task_Failed);
+	}
+}
+
+/*!
+ * @brief 预处理的主体：填充输入、计算插值权重、拆分并提交行带任务
+ * @note 只有提交行带任务（最后一步）成功后，收尾才交给行带；在此之前抛出异常时由 calc_Prepare 收尾
+ */
+void PGDAsyncClass_::calc_PrepareBands(const std::shared_ptr<Struct_AsyncJob> &job) {
+	const PGDClass_::Struct_PGD &struct_dst = job->struct_dst;
+
+	int rows = struct_dst.rows;
+	int n2_sample = struct_dst.n2_sample == PGDClass_::PGD_SampleNums_SameAs_N_Sample ? struct_dst.n_sample : struct_dst.n2_sample;
+	int64 pixel_cost = (int64) struct_dst.cols * struct_dst.n_sample * n2_sample;
+	job->band_rows = struct_dst.exec_config.band_rows > 0 ? struct_dst.exec_config.band_rows
+	                                                      : (int) std::max<int64>(1, PGD_ASYNC_BAND_COST / std::max<int64>(1, pixel_cost));
+	//工作缓冲区按行带任务的划分首次写入
+	PGDClass_::Struct_PGD struct_cfg = struct_dst;
+	struct_cfg.exec_config.band_rows = job->band_rows;
+	PGDClass_::PGD_MemPolicy mem_applied = PGDClass_::PGD_Mem_Plain;
+	job->struct_n4Interp = PGDClass_::calc_PrepareN4(job->src, struct_cfg, job->radius, job->radius_2, job->src_double,
+	                                                 &job->flat_mask, &mem_applied);
+	if (!job->struct_n4Interp) {
+		calc_Finish(job, PGD_Task_Failed);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(job->mutex);
+		job->flat_count = job->flat_mask.empty() ? 0 : cv::countNonZero(job->flat_mask);
+		job->mem_policy_work = mem_applied;
+	}
+	int n_bands = (rows + job->band_rows - 1) / job->band_rows;
+	std::vector<std::function<void()>> tasks;
+	for (int b = 0; b < n_bands; ++b) tasks.emplace_back([job, b] { calc_Band(job, b); });
+	job->bands_total = n_bands;
+	job->bands_left = n_bands;
+	get_Executor().push(tasks);
+}
+
+/*!
+ * @brief 行带任务：开始前检查取消与截止时间，最后一个结束的行带负责收尾
+ * @note 计算中抛出的异常被捕获，该行带记为跳过，整个任务以 PGD_Task_Failed 结束，尚未开始的行带不再计算
+ */
+void PGDAsyncClass_::calc_Band(const std::shared_ptr<Struct_AsyncJob> &job, int band) {
+	PGD_TaskState stop_state;
+	if (get_ShouldStop(*job, stop_state)) {
+		int expected = 0;
+		job->stop_state.compare_exchange_strong(expected, (int) stop_state);
+		++job->bands_skipped;
+	} else {
+		try {
+			int R = job->struct_n4Interp->pad;
+			int row_begin = band * job->band_rows;
+			int row_end = std::min(job->struct_dst.rows, row_begin + job->band_rows);
+			cv::Mat src_band = job->src_double.rowRange(row_begin, row_end + 2 * R);
+			cv::Mat dst_band = job->struct_dst.PGD.rowRange(row_begin, row_end);
+			cv::Mat mask_band = job->flat_mask.empty() ? cv::Mat() : job->flat_mask.rowRange(row_begin, row_end);
+			PGDClass_::calc_TraverseMasked(src_band, dst_band, *job->struct_n4Interp, job->struct_dst.exec_config.strategy, false,
+			                               mask_band, job->struct_dst.flat_code);
+			++job->bands_done;
+		} catch (const std::exception &e) {
+			printf("出现异常，行带 %d 计算失败：%s\n", band, e.what());
+			job->stop_state = (int) PGD_Task_Failed;
+			++job->bands_skipped;
+		} catch (...) {
+			printf("出现异常，行带 %d 计算失败\n", band);
+			job->stop_state = (int) PGD_Task_Failed;
+			++job->bands_skipped;
+		}
+	}
+	if (--job->bands_left == 0) {
+		int reason = job->stop_state.load();
+		calc_Finish(job, reason != 0 ? (PGD_TaskState) reason : PGD_Task_Done);
+	}
+}
+
+/*!
+ * @brief 收尾：释放中间数据、更新统计、调用回调、设置future
+ */
+void PGDAsyncClass_::calc_Finish(const std::shared_ptr<Struct_AsyncJob> &job, PGD_TaskState state) {
+	job->struct_n4Interp.reset();
+	job->src_double.release();
+	job->flat_mask.release();
+	{
+		std::lock_guard<std::mutex> lock(job->mutex);
+		job->run_seconds = get_Seconds(job->start_time, PGD_Clock::now());
+	}
+	job->state = state;
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		--async_stats.n_running;
+		async_stats.n_done += state == PGD_Task_Done;
+		async_stats.n_cancelled += state == PGD_Task_Cancelled;
+		async_stats.n_expired += state == PGD_Task_Expired;
+		async_stats.n_failed += state == PGD_Task_Failed;
+		async_stats.bands_run += job->bands_done;
+		async_stats.bands_skipped += job->bands_skipped;
+		async_stats.run_seconds += job->run_seconds;
+	}
+	Struct_AsyncHandle handle;
+	handle.job = job;
+	//回调抛出的异常不能阻止future被设置，否则等待的线程永远不会返回
+	try {
+		if (job->callback) job->callback(state, handle.get_Info());
+	} catch (...) {
+		printf("出现异常，异步任务的回调抛出了异常\n");
+	}
+	job->promise.set_value(state);
+}
+
+/*!
+ * @brief 执行器的累计统计
+ */
+PGDAsyncClass_::Struct_AsyncStats PGDAsyncClass_::get_AsyncStats() {
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	Struct_AsyncStats stats = async_stats;
+	stats.n_steals = n_steals;
+	return stats;
+}
+
+
+//=======================================================================
+//	句柄
+//=======================================================================
+
+void PGDAsyncClass_::Struct_AsyncHandle::cancel() const {
+	if (job) job->cancel_requested = true;
+}
+
+PGDAsyncClass_::PGD_TaskState PGDAsyncClass_::Struct_AsyncHandle::wait() const {
+	return future.get();
+}
+
+PGDAsyncClass_::Struct_TaskInfo PGDAsyncClass_::Struct_AsyncHandle::get_Info() const {
+	Struct_TaskInfo info;
+	if (!job) return info;
+	info.state = (PGD_TaskState) job->state.load();
+	info.bands_total = job->bands_total;
+	info.bands_done = job->bands_done;
+	info.bands_skipped = job->bands_skipped;
+	std::lock_guard<std::mutex> lock(job->mutex);
+	info.flat_count = job->flat_count;
+	info.mem_policy_work = job->mem_policy_work;
+	if (info.state == PGD_Task_Queued) {
+		info.queue_seconds = get_Seconds(job->submit_time, PGD_Clock::now());
+	} else {
+		info.queue_seconds = job->queue_seconds;
+		info.run_seconds = info.state == PGD_Task_Running ? get_Seconds(job->start_time, PGD_Clock::now()) : job->run_seconds;
+	}
+	return info;
+}
@@ -0,0 +1,107 @@
+
+#include <PGD.h>
+
+/// @file  PGD_Change.cpp
+/// @brief 两幅配准图像之间的变化检测：逐像素比较两个PGD结果的汉明距离
+///
+/// PGD的G值只取决于邻域内的大小关系，对光照变化不敏感，因此两次过境之间的汉明距离可以作为变化信号。
+
+
+/*!
+ * @brief 计算两个PGD结果的逐像素汉明距离图
+ * @param struct_a 第一个PGD结果
+ * @param struct_b 第二个PGD结果，行列数以及【环点】/【子环点】数必须与第一个相同
+ * @param window 局部窗口大小（奇数），大于1时输出窗口内距离之和
+ * @return CV_32SC1 类型的距离图，参数不兼容时返回空矩阵
+ * @note 每一行整行异或后计数，计数内核按CPU指令集分发（见 PGD_Dispatch.cpp）
+ */
+cv::Mat PGDClass_::calc_HammingMap(const Struct_PGD &struct_a, const Struct_PGD &struct_b, int window) {
+	if (struct_a.rows != struct_b.rows || struct_a.cols != struct_b.cols || struct_a.PGD.type() != struct_b.PGD.type()) {
+		printf("出现异常，calc_HammingMap 的两个PGD结果不兼容\n");
+		return cv::Mat();
+	}
+	int rows = struct_a.rows;
+	int cols = struct_a.cols;
+	int elem_size = (int) struct_a.PGD.elemSize();
+	cv::Mat dist(rows, cols, CV_32SC1);
+	cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range &range) {
+		for (int i = range.start; i < range.end; ++i)
+			calc_HammingRow(struct_a.PGD.ptr(i), struct_b.PGD.ptr(i), dist.ptr<int>(i), cols, elem_size);
+	});
+	return window > 1 ? calc_WindowSum(dist, window) : dist;
+}
+
+/*!
+ * @brief 融合版本：计算第二幅图像的PGD，同时与参考结果求汉明距离，不保存第二幅图像的PGD结果
+ * @param struct_ref 参考PGD结果，其配置（【环点】数、【子环点】数、采样方式、执行配置）用于第二幅图像
+ * @param _src 第二幅图像，行列数必须与参考结果相同
+ * @param radius 【环点】半径大小，应与参考结果一致
+ * @param radius_2 【子环点】计算范围，应与参考结果一致
+ * @param window 局部窗口大小（奇数），大于1时输出窗口内距离之和
+ * @return CV_32SC1 类型的距离图，参数不兼容时返回空矩阵
+ * @note 按行带并行，每个线程只保留一个行带大小的PGD缓冲区，计算完立即与参考结果比较。\n
+ * 参考结果设置了 flat_threshold 时，第二幅图像同样按平坦掩码直接写入 flat_code，与参考结果的平坦像素可以直接比较
+ */
+cv::Mat PGDClass_::calc_PGDChangeMap(const Struct_PGD &struct_ref, const cv::_InputArray &_src, double radius, double radius_2, int window) {
+	if (_src.rows() != struct_ref.rows || _src.cols() != struct_ref.cols) {
+		printf("出现异常，calc_PGDChangeMap 的输入图像与参考结果大小不同\n");
+		return cv::Mat();
+	}
+	int rows = struct_ref.rows;
+	int cols = struct_ref.cols;
+	int elem_size = (int) struct_ref.PGD.elemSize();
+
+	cv::Mat src_double, flat_mask;
+	std::unique_ptr<Struct_N4InterpList> struct_n4Interp = calc_PrepareN4(_src.getMat(), struct_ref, radius, radius_2, src_double,
+	                                                                      &flat_mask);
+	if (!struct_n4Interp) return cv::Mat();
+	int R = struct_n4Interp->pad;
+
+	PGD_TraverseStrategy strategy = struct_ref.exec_config.strategy;
+	int band_rows = struct_ref.exec_config.band_rows > 0 ? struct_ref.exec_config.band_rows : 16;
+	int n_bands = (rows + band_rows - 1) / band_rows;
+	cv::Mat dist(rows, cols, CV_32SC1);
+	cv::parallel_for_(cv::Range(0, n_bands), [&](const cv::Range &range) {
+		cv::Mat band_PGD(band_rows, cols, struct_ref.PGD.type());
+		for (int b = range.start; b < range.end; ++b) {
+			int row_begin = b * band_rows;
+			int row_end = std::min(rows, row_begin + band_rows);
+			cv::Mat src_band = src_double.rowRange(row_begin, row_end + 2 * R);
+			cv::Mat dst_band = band_PGD.rowRange(0, row_end - row_begin);
+			cv::Mat mask_band = flat_mask.empty() ? cv::Mat() : flat_mask.rowRange(row_begin, row_end);
+			calc_TraverseMasked(src_band, dst_band, *struct_n4Interp, strategy, false, mask_band, struct_ref.flat_code);
+			for (int i = row_begin; i < row_end; ++i)
+				calc_HammingRow(dst_band.ptr(i - row_begin), struct_ref.PGD.ptr(i), dist.ptr<int>(i), cols, elem_size);
+		}
+	}, n_bands);
+	return window > 1 ? calc_WindowSum(dist, window) : dist;
+}
+
+/*!
+ * @brief 距离图的局部窗口求和
+ * @param dist CV_32SC1 类型的距离图
+ * @param window 窗口大小（奇数，偶数时按window+1处理）
+ * @return CV_32SC1 类型的窗口和，边缘处只统计落在图像内的部分
+ * @note 使用积分图，每个像素的计算量与窗口大小无关
+ */
+cv::Mat PGDClass_::calc_WindowSum(const cv::Mat &dist, int window) {
+	int half = window / 2;
+	int rows = dist.rows;
+	int cols = dist.cols;
+	cv::Mat dist_integral;
+	cv::integral(dist, dist_integral, CV_64F);
+	cv::Mat dst(rows, cols, CV_32SC1);
+	cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range &range) {
+		for (int i = range.start; i < range.end; ++i) {
+			int y1 = std::max(0, i - half), y2 = std::min(rows, i + half + 1);
+			const double *top = dist_integral.ptr<double>(y1);
+			const double *bottom = dist_integral.ptr<double>(y2);
+			int *dst_row = dst.ptr<int>(i);
+			for (int j = 0; j < cols; ++j) {
+				int x1 = std::max(0, j - half), x2 = std::min(cols, j + half + 1);
+				dst_row[j] = (int) (bottom[x2] - bottom[x1] - top[x2] + top[x1]);
+			}
+		}
+	});
+	return dst;
+}
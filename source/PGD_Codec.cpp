@@ -0,0 +1,781 @@
+
+#include <PGD_Codec.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+/// @file  PGD_Codec.cpp
+/// @brief PGD结果的无损压缩：异或预测 + 位平面分离 + 零游程/rANS熵编码，按行组并行；快速模式的位平面只做按字节零游程
+
+#define PGD_CODEC_VERSION 2 ///<版本2增加了 PGD_PLANE_ZERORUN，版本1的码流仍可解码
+#define PGD_CODEC_HEADER_BYTES 24
+#define PGD_RANS_PROB_BITS 12 ///<频率表精度，频率之和为 1 << 12
+#define PGD_RANS_LOWER (1u << 23) ///<rANS状态的下界
+#define PGD_RANS_WAYS 4 ///<交织的rANS状态个数，相邻记号使用不同的状态以提高指令级并行
+#define PGD_PLANE_ZERO 0 ///<位平面全为0
+#define PGD_PLANE_RAW 1 ///<位平面保存原始字节
+#define PGD_PLANE_RANS 2 ///<位平面使用零游程 + rANS编码：编码后字节数(u32)，随后是rANS码流
+#define PGD_PLANE_ZERORUN 3 ///<位平面只做按字节的零游程（快速模式），见 calc_ZeroRunBytes
+#define PGD_TOKEN_RUNA 0 ///<零游程记号，双射二进制的数字1
+#define PGD_TOKEN_RUNB 1 ///<零游程记号，双射二进制的数字2
+#define PGD_TOKEN_COUNT 257 ///<记号种类数：2个零游程记号 + 255个非0字节
+
+
+//=======================================================================
+//	小工具
+//=======================================================================
+
+static void put_U32(uchar *out, uint32_t value) {
+	for (int t = 0; t < 4; ++t) out[t] = (uchar) (value >> (8 * t));
+}
+
+static void put_U64(uchar *out, uint64 value) {
+	for (int t = 0; t < 8; ++t) out[t] = (uchar) (value >> (8 * t));
+}
+
+static uint32_t get_U32(const uchar *in) {
+	return (uint32_t) in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+static uint64 get_U64(const uchar *in) {
+	return (uint64) get_U32(in) | ((uint64) get_U32(in + 4) << 32);
+}
+
+static void put_VarUInt(std::vector<uchar> &out, uint64 value) {
+	for (; value >= 0x80; value >>= 7) out.push_back((uchar) (value | 0x80));
+	out.push_back((uchar) value);
+}
+
+static bool get_VarUInt(const uchar *&in, const uchar *end, uint64 &value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && in < end; shift += 7) {
+		uchar byte = *in++;
+		value |= (uint64) (byte & 0x7F) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+/*!
+ * @brief 一段字节中置1的位数
+ * @note 按64位字做SWAR计数，不依赖popcnt指令，编译器可以向量化
+ */
+static uint64 get_BitCount(const uchar *data, size_t n) {
+	uint64 count = 0;
+	size_t k = 0;
+	for (; k + 8 <= n; k += 8) {
+		uint64 x;
+		memcpy(&x, data + k, 8);
+		x = x - ((x >> 1) & 0x5555555555555555ull);
+		x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+		x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+		count += (x * 0x0101010101010101ull) >> 56;
+	}
+	for (; k < n; ++k)
+		for (uchar v = data[k]; v != 0; v &= v - 1) ++count;
+	return count;
+}
+
+/*!
+ * @brief 8×8位矩阵转置：第i字节的第j位与第j字节的第i位互换
+ * @note 8个像素某一字节的值（每个像素一字节）转置为8个位平面字节（每个位平面一字节，每位对应一个像素）
+ */
+static inline uint64 calc_Transpose8x8(uint64 x) {
+	x = (x & 0xAA55AA55AA55AA55ull) | ((x & 0x00AA00AA00AA00AAull) << 7) | ((x >> 7) & 0x00AA00AA00AA00AAull);
+	x = (x & 0xCCCC3333CCCC3333ull) | ((x & 0x0000CCCC0000CCCCull) << 14) | ((x >> 14) & 0x0000CCCC0000CCCCull);
+	x = (x & 0xF0F0F0F00F0F0F0Full) | ((x & 0x00000000F0F0F0F0ull) << 28) | ((x >> 28) & 0x00000000F0F0F0F0ull);
+	return x;
+}
+
+
+//=======================================================================
+//	零游程 + rANS 熵编码（静态0阶模型，字节输出）
+//=======================================================================
+//	按字节的零游程（快速模式）
+//=======================================================================
+
+/*!
+ * @brief 一段字节按零游程编码：重复 (0字节个数, 非0段字节数, 非0段原始字节)，两个数都用变长整数
+ * @note 非0段遇到连续两个0字节（或到达末尾）时结束，单个0字节留在非0段中，避免为它多写两个长度。
+ * 0字节按64位字跳过，编码与解码都只有比较和拷贝
+ */
+static void calc_ZeroRunBytes(const uchar *data, size_t n, std::vector<uchar> &out) {
+	for (size_t k = 0; k < n;) {
+		size_t zero_begin = k;
+		uint64 word = 0;
+		while (k + 8 <= n && (memcpy(&word, data + k, 8), word == 0)) k += 8;
+		while (k < n && data[k] == 0) ++k;
+		size_t literal_begin = k;
+		for (;;) {
+			///整个字都不含0字节时直接跳过（最低的0字节一定会被检测到，只需要判断有无）
+			while (k + 8 <= n && (memcpy(&word, data + k, 8),
+					((word - 0x0101010101010101ull) & ~word & 0x8080808080808080ull) == 0))
+				k += 8;
+			if (k >= n || (data[k] == 0 && (k + 1 == n || data[k + 1] == 0))) break;
+			++k;
+		}
+		put_VarUInt(out, literal_begin - zero_begin);
+		put_VarUInt(out, k - literal_begin);
+		out.insert(out.end(), data + literal_begin, data + k);
+	}
+}
+
+/*!
+ * @brief calc_ZeroRunBytes 的逆过程
+ * @param in [输入输出] 码流位置，解码后移动到下一段
+ * @param end 码流结束位置
+ * @param data [输出] 解码的字节
+ * @param n 字节数
+ * @return 码流损坏时返回false
+ */
+static bool calc_ZeroRunBytesDecode(const uchar *&in, const uchar *end, uchar *data, size_t n) {
+	for (size_t k = 0; k < n;) {
+		uint64 zeros = 0, literal = 0;
+		if (!get_VarUInt(in, end, zeros) || !get_VarUInt(in, end, literal)) return false;
+		if (zeros + literal == 0 || zeros > n - k || literal > n - k - zeros || literal > (uint64) (end - in)) return false;
+		memset(data + k, 0, zeros);
+		k += zeros;
+		memcpy(data + k, in, literal);
+		in += literal;
+		k += literal;
+	}
+	return true;
+}
+
+
+//=======================================================================
+
+/*!
+ * @brief 位平面字节转换为零游程记号
+ * @note 非0字节v记为v+1；连续n个0字节按双射二进制记为 RUNA(1)/RUNB(2) 数字序列（与bzip2相同）。
+ * 稀疏的位平面记号数远少于字节数，熵编码的计算量随之减少
+ * @return 记号个数（不超过字节数）
+ */
+static size_t calc_ZeroRunTokens(const uchar *plane, size_t n, uint16_t *tokens) {
+	size_t n_tokens = 0;
+	for (size_t k = 0; k < n;) {
+		if (plane[k] != 0) {
+			tokens[n_tokens++] = (uint16_t) (plane[k++] + 1);
+			continue;
+		}
+		size_t run_begin = k;
+		uint64 word = 0;
+		while (k + 8 <= n && (memcpy(&word, plane + k, 8), word == 0)) k += 8;
+		while (k < n && plane[k] == 0) ++k;
+		for (size_t run = k - run_begin; run > 0;) {
+			if (run & 1) {
+				tokens[n_tokens++] = PGD_TOKEN_RUNA;
+				run = (run - 1) >> 1;
+			} else {
+				tokens[n_tokens++] = PGD_TOKEN_RUNB;
+				run = (run - 2) >> 1;
+			}
+		}
+	}
+	return n_tokens;
+}
+
+/*!
+ * @brief 记号频率归一化，使频率之和为 1 << PGD_RANS_PROB_BITS，出现过的记号频率至少为1
+ */
+static void calc_NormalizeFreq(const size_t counts[PGD_TOKEN_COUNT], size_t n, uint32_t freq[PGD_TOKEN_COUNT]) {
+	const uint32_t total = 1u << PGD_RANS_PROB_BITS;
+	uint32_t sum = 0;
+	for (int s = 0; s < PGD_TOKEN_COUNT; ++s) {
+		freq[s] = counts[s] == 0 ? 0 : std::max<uint32_t>(1, (uint32_t) ((double) counts[s] * total / (double) n));
+		sum += freq[s];
+	}
+	///误差由频率最大的记号吸收
+	while (sum != total) {
+		int largest = 0;
+		for (int s = 1; s < PGD_TOKEN_COUNT; ++s)
+			if (freq[s] > freq[largest]) largest = s;
+		if (sum < total) {
+			freq[largest] += total - sum;
+			sum = total;
+		} else {
+			uint32_t cut = std::max<uint32_t>(1, std::min(sum - total, freq[largest] - 1));
+			freq[largest] -= cut;
+			sum -= cut;
+		}
+	}
+}
+
+/*!
+ * @struct Struct_RansSymbol
+ * @brief 编码一个记号所需的参数，用倒数乘法代替除法
+ * @note x' = (x / f) · 2^PROB_BITS + x % f + cum = x + bias + q · (2^PROB_BITS - f)，其中 q = x / f
+ */
+struct Struct_RansSymbol {
+	uint32_t x_max, rcp_freq, rcp_shift, bias, cmpl_freq;
+};
+
+static inline void calc_RansPut(uint32_t &x, uchar *&ptr, const Struct_RansSymbol &symbol) {
+	while (x >= symbol.x_max) {
+		*--ptr = (uchar) x;
+		x >>= 8;
+	}
+	uint32_t q = (uint32_t) (((uint64) x * symbol.rcp_freq) >> 32) >> symbol.rcp_shift;
+	x += symbol.bias + q * symbol.cmpl_freq;
+}
+
+/*!
+ * @brief rANS编码，结果追加到out：记号个数、频率表（记号序号差、频率，均为变长整数）、码流
+ * @param tokens 记号
+ * @param n 记号个数，大于0
+ * @param counts 每个记号出现的次数
+ * @param out [输出]
+ * @note 编码从后往前进行，PGD_RANS_WAYS 个状态交织，第i个记号使用第 i % PGD_RANS_WAYS 个状态
+ */
+static void calc_RansEncode(const uint16_t *tokens, size_t n, const size_t counts[PGD_TOKEN_COUNT], std::vector<uchar> &out) {
+	uint32_t freq[PGD_TOKEN_COUNT];
+	calc_NormalizeFreq(counts, n, freq);
+	int n_symbols = 0;
+	for (int s = 0; s < PGD_TOKEN_COUNT; ++s) n_symbols += freq[s] != 0;
+	put_VarUInt(out, n);
+	put_VarUInt(out, (uint64) n_symbols);
+
+	Struct_RansSymbol symbols[PGD_TOKEN_COUNT];
+	uint32_t cum = 0;
+	int prev = -1;
+	for (int s = 0; s < PGD_TOKEN_COUNT; ++s) {
+		uint32_t f = freq[s];
+		if (f == 0) continue;
+		put_VarUInt(out, (uint64) (s - prev - 1));
+		put_VarUInt(out, f);
+		prev = s;
+
+		Struct_RansSymbol &symbol = symbols[s];
+		symbol.x_max = ((PGD_RANS_LOWER >> PGD_RANS_PROB_BITS) << 8) * f;
+		symbol.cmpl_freq = (1u << PGD_RANS_PROB_BITS) - f;
+		if (f < 2) {
+			symbol.rcp_freq = ~0u;
+			symbol.rcp_shift = 0;
+			symbol.bias = cum + (1u << PGD_RANS_PROB_BITS) - 1;
+		} else {
+			uint32_t shift = 0;
+			while (f > (1u << shift)) ++shift;
+			symbol.rcp_freq = (uint32_t) ((((uint64) 1 << (shift + 31)) + f - 1) / f);
+			symbol.rcp_shift = shift - 1;
+			symbol.bias = cum;
+		}
+		cum += f;
+	}
+
+	///最坏情况下每个记号输出 PGD_RANS_PROB_BITS 位
+	std::vector<uchar> buffer(n * 2 + 4 * PGD_RANS_WAYS + 16);
+	uchar *ptr = buffer.data() + buffer.size();
+	uint32_t x[PGD_RANS_WAYS];
+	for (uint32_t &state : x) state = PGD_RANS_LOWER;
+	size_t i = n;
+	for (; i % PGD_RANS_WAYS != 0; --i) calc_RansPut(x[(i - 1) % PGD_RANS_WAYS], ptr, symbols[tokens[i - 1]]);
+	uint32_t x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3];
+	for (; i > 0; i -= PGD_RANS_WAYS) {
+		calc_RansPut(x3, ptr, symbols[tokens[i - 1]]);
+		calc_RansPut(x2, ptr, symbols[tokens[i - 2]]);
+		calc_RansPut(x1, ptr, symbols[tokens[i - 3]]);
+		calc_RansPut(x0, ptr, symbols[tokens[i - 4]]);
+	}
+	///第0个状态最后写入，位于码流最前面，解码时最先读取
+	for (uint32_t state : {x3, x2, x1, x0}) {
+		ptr -= 4;
+		put_U32(ptr, state);
+	}
+	out.insert(out.end(), ptr, buffer.data() + buffer.size());
+}
+
+/*!
+ * @brief rANS解码并还原零游程，得到位平面字节
+ * @param in 码流（从记号个数开始）
+ * @param size 码流字节数
+ * @param plane [输出] 位平面字节
+ * @param n 位平面字节数
+ * @return 码流损坏或记号与字节数不符时返回false
+ * @note 每个记号最多读取2字节，剩余码流不少于 2·PGD_RANS_WAYS 字节时一次解码 PGD_RANS_WAYS 个记号且不检查越界
+ */
+static bool calc_RansDecode(const uchar *in, size_t size, uchar *plane, size_t n) {
+	const uchar *end = in + size;
+	uint64 n_tokens = 0, n_symbols = 0;
+	if (!get_VarUInt(in, end, n_tokens) || !get_VarUInt(in, end, n_symbols) || n_tokens > n || n_symbols > PGD_TOKEN_COUNT)
+		return false;
+	///每个槽位的记号、频率、累计频率放在一起，一次查表
+	struct Struct_Slot {
+		uint16_t token, freq, cum;
+	} slots[1u << PGD_RANS_PROB_BITS];
+	uint32_t acc = 0;
+	int prev = -1;
+	for (uint64 t = 0; t < n_symbols; ++t) {
+		uint64 delta = 0, f = 0;
+		if (!get_VarUInt(in, end, delta) || !get_VarUInt(in, end, f)) return false;
+		if (delta >= (uint64) (PGD_TOKEN_COUNT - 1 - prev) || f == 0 || acc + f > (1u << PGD_RANS_PROB_BITS)) return false;
+		int s = prev + 1 + (int) delta;
+		for (uint32_t slot = acc; slot < acc + f; ++slot) slots[slot] = {(uint16_t) s, (uint16_t) f, (uint16_t) acc};
+		acc += (uint32_t) f;
+		prev = s;
+	}
+	if (acc != (1u << PGD_RANS_PROB_BITS) || end - in < 4 * PGD_RANS_WAYS) return false;
+
+	uint32_t x[PGD_RANS_WAYS];
+	for (uint32_t &state : x) {
+		state = get_U32(in);
+		in += 4;
+	}
+	const uint32_t mask = (1u << PGD_RANS_PROB_BITS) - 1;
+	size_t k = 0, run = 0, weight = 1;
+	///还原一个记号：零游程累加，遇到非0字节时先写出累计的0
+	auto put_Token = [&](uint16_t token) -> bool {
+		if (token <= PGD_TOKEN_RUNB) {
+			run += token == PGD_TOKEN_RUNA ? weight : 2 * weight;
+			weight <<= 1;
+			return run <= n - k;
+		}
+		if (run != 0) {
+			if (run >= n - k) return false;
+			memset(plane + k, 0, run);
+			k += run;
+			run = 0;
+			weight = 1;
+		} else if (k >= n) {
+			return false;
+		}
+		plane[k++] = (uchar) (token - 1);
+		return true;
+	};
+	auto get_Token = [&](uint32_t &state) -> uint16_t {
+		const Struct_Slot &slot = slots[state & mask];
+		state = slot.freq * (state >> PGD_RANS_PROB_BITS) + (state & mask) - slot.cum;
+		return slot.token;
+	};
+	uint32_t x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3];
+	size_t i = 0;
+	for (; i + PGD_RANS_WAYS <= n_tokens && end - in >= 2 * PGD_RANS_WAYS; i += PGD_RANS_WAYS) {
+		uint16_t t0 = get_Token(x0), t1 = get_Token(x1), t2 = get_Token(x2), t3 = get_Token(x3);
+		while (x0 < PGD_RANS_LOWER) x0 = (x0 << 8) | *in++;
+		while (x1 < PGD_RANS_LOWER) x1 = (x1 << 8) | *in++;
+		while (x2 < PGD_RANS_LOWER) x2 = (x2 << 8) | *in++;
+		while (x3 < PGD_RANS_LOWER) x3 = (x3 << 8) | *in++;
+		if (!put_Token(t0) || !put_Token(t1) || !put_Token(t2) || !put_Token(t3)) return false;
+	}
+	x[0] = x0, x[1] = x1, x[2] = x2, x[3] = x3;
+	for (; i < n_tokens; ++i) {
+		uint32_t &state = x[i % PGD_RANS_WAYS];
+		uint16_t token = get_Token(state);
+		while (state < PGD_RANS_LOWER) {
+			if (in >= end) return false;
+			state = (state << 8) | *in++;
+		}
+		if (!put_Token(token)) return false;
+	}
+	if (run != n - k) return false;
+	memset(plane + k, 0, run);
+	return true;
+}
+
+
+//=======================================================================
+//	行组编解码
+//=======================================================================
+
+/*!
+ * @brief 一行残差拆成位平面
+ * @param residual 一行残差（按像素交织的原始字节，长度补齐到8个像素的倍数，补齐部分为0）
+ * @param planes 第0个位平面该行的起始位置
+ * @param plane_stride 相邻两个位平面的间隔
+ * @param plane_bytes 每行位平面的字节数
+ * @param channels 通道数
+ * @param channel_bytes 每个通道的字节数
+ * @note 位平面序号 = 通道 × 位数 + 位；每8个像素的同一字节转置一次得到8个位平面各1字节
+ */
+static void calc_SplitPlanes(const uchar *residual, uchar *planes, size_t plane_stride, size_t plane_bytes,
+                             int channels, int channel_bytes) {
+	size_t elem_size = (size_t) channels * channel_bytes;
+	for (size_t k = 0; k < plane_bytes; ++k) {
+		const uchar *block = residual + k * 8 * elem_size;
+		for (size_t lane = 0; lane < elem_size; ++lane) {
+			uint64 x = 0;
+			for (int t = 0; t < 8; ++t) x |= (uint64) block[t * elem_size + lane] << (8 * t);
+			if (x == 0) continue;
+			x = calc_Transpose8x8(x);
+			uchar *plane = planes + lane * 8 * plane_stride + k;
+			for (int b = 0; b < 8; ++b, plane += plane_stride) *plane = (uchar) (x >> (8 * b));
+		}
+	}
+}
+
+/*!
+ * @brief 位平面合并为一行残差，calc_SplitPlanes 的逆过程
+ */
+static void calc_MergePlanes(const uchar *planes, size_t plane_stride, size_t plane_bytes, int channels, int channel_bytes,
+                             uchar *residual) {
+	size_t elem_size = (size_t) channels * channel_bytes;
+	for (size_t k = 0; k < plane_bytes; ++k) {
+		uchar *block = residual + k * 8 * elem_size;
+		for (size_t lane = 0; lane < elem_size; ++lane) {
+			const uchar *plane = planes + lane * 8 * plane_stride + k;
+			uint64 x = 0;
+			for (int b = 0; b < 8; ++b, plane += plane_stride) x |= (uint64) *plane << (8 * b);
+			if (x != 0) x = calc_Transpose8x8(x);
+			for (int t = 0; t < 8; ++t) block[t * elem_size + lane] = (uchar) (x >> (8 * t));
+		}
+	}
+}
+
+/*!
+ * @brief 编码一个行组
+ * @param PGD_group 行组的数据（ROI）
+ * @param payload [输出] 行组码流
+ * @param mode 编码模式
+ * @note ① 每行选择左邻或上邻异或预测（行组第一行只能用左邻），取残差置1位数较少的一种。
+ * 异或按字节进行：左邻就是前一个像素（elemSize字节之前），上邻就是上一行\n
+ * ② 残差按 [通道·位][行][列/8] 的顺序拆成位平面，每个位平面（行组内所有行）单独编码：
+ * 全为0时只记录方式；按0阶熵估计可以压缩时用零游程 + rANS（每个位平面有自己的频率表）；否则直接保存原始字节\n
+ * ③ 快速模式不比较两种预测（第0行左邻，其余行上邻），位平面不做熵估计和rANS，只用按字节的零游程，比原始字节短时采用
+ */
+void PGDCodecClass_::calc_EncodeGroup(const cv::Mat &PGD_group, std::vector<uchar> &payload, PGD_CodecMode mode) {
+	int rows = PGD_group.rows;
+	int channels = PGD_group.channels();
+	int channel_bytes = (int) PGD_group.elemSize1();
+	size_t elem_size = PGD_group.elemSize();
+	size_t row_bytes = PGD_group.cols * elem_size;
+	size_t plane_bytes = (size_t) (PGD_group.cols + 7) / 8;
+	size_t plane_stride = (size_t) rows * plane_bytes;//相邻两个位平面的间隔，也是一个位平面的字节数
+	size_t n_planes = elem_size * 8;
+
+	payload.assign(rows, 0);
+	std::vector<uchar> planes(n_planes * plane_stride, 0);
+	std::vector<uchar> residual_left(plane_bytes * 8 * elem_size, 0), residual_up(plane_bytes * 8 * elem_size, 0);
+	for (int i = 0; i < rows; ++i) {
+		const uchar *row_ptr = PGD_group.ptr(i);
+		bool use_up = i > 0 && mode == PGD_Codec_Fast;
+		if (!use_up) {
+			std::copy(row_ptr, row_ptr + std::min(elem_size, row_bytes), residual_left.begin());
+			for (size_t k = elem_size; k < row_bytes; ++k) residual_left[k] = row_ptr[k] ^ row_ptr[k - elem_size];
+		}
+		if (i > 0) {
+			const uchar *up_ptr = PGD_group.ptr(i - 1);
+			for (size_t k = 0; k < row_bytes; ++k) residual_up[k] = row_ptr[k] ^ up_ptr[k];
+			use_up = use_up || get_BitCount(residual_up.data(), row_bytes) < get_BitCount(residual_left.data(), row_bytes);
+		}
+		payload[i] = (uchar) use_up;
+		calc_SplitPlanes(use_up ? residual_up.data() : residual_left.data(), &planes[(size_t) i * plane_bytes],
+		                 plane_stride, plane_bytes, channels, channel_bytes);
+	}
+
+	if (mode == PGD_Codec_Fast) {
+		for (size_t p = 0; p < n_planes; ++p) {
+			const uchar *plane = &planes[p * plane_stride];
+			size_t mode_pos = payload.size();
+			payload.push_back(PGD_PLANE_ZERORUN);
+			calc_ZeroRunBytes(plane, plane_stride, payload);
+			if (payload.size() - mode_pos - 1 <= 2) {
+				payload.resize(mode_pos);
+				payload.push_back(PGD_PLANE_ZERO);
+			} else if (payload.size() - mode_pos - 1 >= plane_stride) {
+				payload.resize(mode_pos);
+				payload.push_back(PGD_PLANE_RAW);
+				payload.insert(payload.end(), plane, plane + plane_stride);
+			}
+		}
+		return;
+	}
+
+	std::vector<uint16_t> tokens(plane_stride);
+	for (size_t p = 0; p < n_planes; ++p) {
+		const uchar *plane = &planes[p * plane_stride];
+		///置1位的比例在 [0.35, 0.65] 之间时，按位的熵已超过0.93，直接保存原始字节
+		uint64 n_ones = get_BitCount(plane, plane_stride);
+		if (n_ones > 0.35 * 8 * plane_stride && n_ones < 0.65 * 8 * plane_stride) {
+			payload.push_back(PGD_PLANE_RAW);
+			payload.insert(payload.end(), plane, plane + plane_stride);
+			continue;
+		}
+		if (n_ones == 0) {
+			payload.push_back(PGD_PLANE_ZERO);
+			continue;
+		}
+		size_t n_tokens = calc_ZeroRunTokens(plane, plane_stride, tokens.data());
+		size_t counts[PGD_TOKEN_COUNT] = {0};
+		for (size_t t = 0; t < n_tokens; ++t) ++counts[tokens[t]];
+		///0阶熵估计的压缩后字节数（含频率表）
+		double estimate = 8 + 4 * PGD_RANS_WAYS;
+		for (int s = 0; s < PGD_TOKEN_COUNT; ++s)
+			if (counts[s] != 0) estimate += 3 + counts[s] * log2((double) n_tokens / counts[s]) / 8;
+		if (estimate < 0.9 * plane_stride) {
+			size_t mode_pos = payload.size();
+			payload.push_back(PGD_PLANE_RANS);
+			payload.resize(payload.size() + 4);
+			calc_RansEncode(tokens.data(), n_tokens, counts, payload);
+			size_t coded = payload.size() - mode_pos - 5;
+			if (coded < plane_stride) {
+				put_U32(&payload[mode_pos + 1], (uint32_t) coded);
+				continue;
+			}
+			payload.resize(mode_pos);
+		}
+		payload.push_back(PGD_PLANE_RAW);
+		payload.insert(payload.end(), plane, plane + plane_stride);
+	}
+}
+
+/*!
+ * @brief 解码一个行组
+ * @param payload 行组码流
+ * @param size 码流字节数
+ * @param PGD_group [输出] 行组的数据（ROI），行列数、类型决定码流的解释方式
+ * @return 码流损坏时返回false
+ */
+bool PGDCodecClass_::calc_DecodeGroup(const uchar *payload, size_t size, cv::Mat &PGD_group) {
+	int rows = PGD_group.rows;
+	int channels = PGD_group.channels();
+	int channel_bytes = (int) PGD_group.elemSize1();
+	size_t elem_size = PGD_group.elemSize();
+	size_t row_bytes = PGD_group.cols * elem_size;
+	size_t plane_bytes = (size_t) (PGD_group.cols + 7) / 8;
+	size_t plane_stride = (size_t) rows * plane_bytes;
+	size_t n_planes = elem_size * 8;
+
+	const uchar *end = payload + size;
+	if (size < (size_t) rows) return false;
+	const uchar *modes = payload;
+	const uchar *in = payload + rows;
+	std::vector<uchar> planes(n_planes * plane_stride);
+	for (size_t p = 0; p < n_planes; ++p) {
+		uchar *plane = &planes[p * plane_stride];
+		if (in >= end) return false;
+		uchar mode = *in++;
+		if (mode == PGD_PLANE_ZERO) {
+			memset(plane, 0, plane_stride);
+		} else if (mode == PGD_PLANE_RAW) {
+			if ((size_t) (end - in) < plane_stride) return false;
+			memcpy(plane, in, plane_stride);
+			in += plane_stride;
+		} else if (mode == PGD_PLANE_RANS) {
+			if (end - in < 4) return false;
+			size_t coded = get_U32(in);
+			in += 4;
+			if ((size_t) (end - in) < coded || !calc_RansDecode(in, coded, plane, plane_stride)) return false;
+			in += coded;
+		} else if (mode == PGD_PLANE_ZERORUN) {
+			if (!calc_ZeroRunBytesDecode(in, end, plane, plane_stride)) return false;
+		} else {
+			return false;
+		}
+	}
+
+	std::vector<uchar> residual(plane_bytes * 8 * elem_size);
+	for (int i = 0; i < rows; ++i) {
+		uchar *row_ptr = PGD_group.ptr(i);
+		calc_MergePlanes(&planes[(size_t) i * plane_bytes], plane_stride, plane_bytes, channels, channel_bytes, residual.data());
+		///撤销预测
+		if (modes[i] != 0) {
+			if (i == 0) return false;
+			const uchar *up_ptr = PGD_group.ptr(i - 1);
+			for (size_t k = 0; k < row_bytes; ++k) row_ptr[k] = residual[k] ^ up_ptr[k];
+		} else {
+			std::copy(residual.begin(), residual.begin() + std::min(elem_size, row_bytes), row_ptr);
+			for (size_t k = elem_size; k < row_bytes; ++k) row_ptr[k] = residual[k] ^ row_ptr[k - elem_size];
+		}
+	}
+	return true;
+}
+
+
+//=======================================================================
+//	对外接口
+//=======================================================================
+
+/*!
+ * @brief 压缩PGD结果
+ * @param struct_pgd PGD结果
+ * @param stream [输出] 码流
+ * @param group_rows 每个行组的行数，也是部分解码的最小粒度
+ * @param mode 编码模式，见 PGD_CodecMode
+ * @return 参数不合法时返回false
+ * @note 各行组并行编码
+ */
+bool PGDCodecClass_::calc_Encode(const PGDClass_::Struct_PGD &struct_pgd, std::vector<uchar> &stream, int group_rows,
+                                 PGD_CodecMode mode) {
+	const cv::Mat &PGD = struct_pgd.PGD;
+	if (PGD.empty() || group_rows <= 0) {
+		printf("出现异常，calc_Encode 的PGD结果为空或行组行数不合法\n");
+		return false;
+	}
+	int rows = PGD.rows;
+	int n_groups = (rows + group_rows - 1) / group_rows;
+	std::vector<std::vector<uchar>> payloads(n_groups);
+	cv::parallel_for_(cv::Range(0, n_groups), [&](const cv::Range &range) {
+		for (int g = range.start; g < range.end; ++g) {
+			cv::Mat PGD_group = PGD.rowRange(g * group_rows, std::min(rows, (g + 1) * group_rows));
+			calc_EncodeGroup(PGD_group, payloads[g], mode);
+		}
+	}, n_groups);
+
+	size_t data_offset = PGD_CODEC_HEADER_BYTES + (size_t) (n_groups + 1) * 8;
+	size_t total = data_offset;
+	for (const std::vector<uchar> &payload : payloads) total += payload.size();
+	stream.assign(total, 0);
+
+	uchar *header = stream.data();
+	memcpy(header, "PGDC", 4);
+	header[4] = PGD_CODEC_VERSION;
+	header[5] = (uchar) struct_pgd.n_sample;
+	header[6] = (uchar) struct_pgd.n2_sample;
+	header[7] = (uchar) PGD.elemSize1();
+	put_U32(header + 8, (uint32_t) rows);
+	put_U32(header + 12, (uint32_t) PGD.cols);
+	put_U32(header + 16, (uint32_t) group_rows);
+	put_U32(header + 20, (uint32_t) n_groups);
+
+	uint64 offset = 0;
+	uchar *data = stream.data() + data_offset;
+	for (int g = 0; g < n_groups; ++g) {
+		put_U64(header + PGD_CODEC_HEADER_BYTES + (size_t) g * 8, offset);
+		memcpy(data + offset, payloads[g].data(), payloads[g].size());
+		offset += payloads[g].size();
+	}
+	put_U64(header + PGD_CODEC_HEADER_BYTES + (size_t) n_groups * 8, offset);
+	return true;
+}
+
+/*!
+ * @brief 读取并检查码流的文件头
+ * @param stream 码流
+ * @param size 码流字节数
+ * @param header [输出] 文件头
+ * @return 不是合法的码流时返回false
+ */
+bool PGDCodecClass_::read_Header(const uchar *stream, size_t size, Struct_CodecHeader &header) {
+	if (stream == nullptr || size < PGD_CODEC_HEADER_BYTES || memcmp(stream, "PGDC", 4) != 0 || stream[4] < 1 ||
+	    stream[4] > PGD_CODEC_VERSION)
+		return false;
+	header.n_sample = stream[5];
+	header.n2_sample = stream[6];
+	header.channel_bytes = stream[7];
+	header.rows = (int) get_U32(stream + 8);
+	header.cols = (int) get_U32(stream + 12);
+	header.group_rows = (int) get_U32(stream + 16);
+	header.n_groups = (int) get_U32(stream + 20);
+	header.channels = header.n_sample;
+	header.data_offset = PGD_CODEC_HEADER_BYTES + (size_t) (header.n_groups + 1) * 8;
+
+	int n2_sample = header.n2_sample == 0 ? header.n_sample : header.n2_sample;
+	int channel_bytes = n2_sample <= 8 ? 1 : n2_sample / 8;
+	if (header.channels <= 0 || header.channel_bytes != channel_bytes || header.rows <= 0 || header.cols <= 0 ||
+	    header.group_rows <= 0 || header.n_groups != (header.rows + header.group_rows - 1) / header.group_rows ||
+	    size < header.data_offset)
+		return false;
+	return size - header.data_offset >= get_U64(stream + header.data_offset - 8);
+}
+
+/*!
+ * @brief 解压得到完整的PGD结果
+ * @param stream 码流
+ * @param size 码流字节数
+ * @return PGD结果，码流不合法时返回空指针
+ * @note 各行组并行解码
+ */
+std::unique_ptr<PGDClass_::Struct_PGD> PGDCodecClass_::calc_Decode(const uchar *stream, size_t size) {
+	Struct_CodecHeader header;
+	if (!read_Header(stream, size, header)) {
+		printf("出现异常，calc_Decode 的输入不是合法的PGD码流\n");
+		return nullptr;
+	}
+	std::unique_ptr<PGDClass_::Struct_PGD> struct_pgd(
+			new PGDClass_::Struct_PGD(header.rows, header.cols, (PGDClass_::PGD_SampleNums) header.n_sample,
+			                          (PGDClass_::PGD_SampleNums) header.n2_sample));
+	const uchar *offsets = stream + PGD_CODEC_HEADER_BYTES;
+	const uchar *data = stream + header.data_offset;
+	uint64 data_size = size - header.data_offset;
+	std::atomic<bool> ok(true);
+	cv::parallel_for_(cv::Range(0, header.n_groups), [&](const cv::Range &range) {
+		for (int g = range.start; g < range.end; ++g) {
+			uint64 begin = get_U64(offsets + (size_t) g * 8), end = get_U64(offsets + (size_t) g * 8 + 8);
+			cv::Mat PGD_group = struct_pgd->PGD.rowRange(g * header.group_rows, std::min(header.rows, (g + 1) * header.group_rows));
+			if (begin > end || end > data_size || !calc_DecodeGroup(data + begin, end - begin, PGD_group)) ok = false;
+		}
+	}, header.n_groups);
+	if (!ok) {
+		printf("出现异常，PGD码流已损坏\n");
+		return nullptr;
+	}
+	return struct_pgd;
+}
+
+/*!
+ * @brief 只解码一部分行
+ * @param stream 码流
+ * @param size 码流字节数
+ * @param row_begin 起始行
+ * @param row_end 结束行（不包含）
+ * @return (row_end - row_begin) 行的PGD数据，类型与原结果相同，参数或码流不合法时返回空矩阵
+ * @note 只解码与行范围相交的行组
+ */
+cv::Mat PGDCodecClass_::calc_DecodeRows(const uchar *stream, size_t size, int row_begin, int row_end) {
+	Struct_CodecHeader header;
+	if (!read_Header(stream, size, header) || row_begin < 0 || row_end > header.rows || row_begin >= row_end) {
+		printf("出现异常，calc_DecodeRows 的码流或行范围不合法\n");
+		return cv::Mat();
+	}
+	int type = CV_MAKETYPE(header.channel_bytes == 1 ? CV_8U : (header.channel_bytes == 2 ? CV_16U : (header.channel_bytes == 4 ? CV_32S : CV_64F)), header.channels);
+	cv::Mat dst(row_end - row_begin, header.cols, type);
+	const uchar *offsets = stream + PGD_CODEC_HEADER_BYTES;
+	const uchar *data = stream + header.data_offset;
+	uint64 data_size = size - header.data_offset;
+	int group_begin = row_begin / header.group_rows;
+	int group_end = (row_end + header.group_rows - 1) / header.group_rows;
+	std::atomic<bool> ok(true);
+	cv::parallel_for_(cv::Range(group_begin, group_end), [&](const cv::Range &range) {
+		for (int g = range.start; g < range.end; ++g) {
+			int group_row_begin = g * header.group_rows;
+			int group_row_end = std::min(header.rows, group_row_begin + header.group_rows);
+			cv::Mat PGD_group(group_row_end - group_row_begin, header.cols, type);
+			uint64 begin = get_U64(offsets + (size_t) g * 8), end = get_U64(offsets + (size_t) g * 8 + 8);
+			if (begin > end || end > data_size || !calc_DecodeGroup(data + begin, end - begin, PGD_group)) {
+				ok = false;
+				continue;
+			}
+			int copy_begin = std::max(row_begin, group_row_begin);
+			int copy_end = std::min(row_end, group_row_end);
+			PGD_group.rowRange(copy_begin - group_row_begin, copy_end - group_row_begin)
+					.copyTo(dst.rowRange(copy_begin - row_begin, copy_end - row_begin));
+		}
+	}, group_end - group_begin);
+	if (!ok) {
+		printf("出现异常，PGD码流已损坏\n");
+		return cv::Mat();
+	}
+	return dst;
+}
+
+/*!
+ * @brief 压缩PGD结果并写入文件
+ */
+bool PGDCodecClass_::save_PGD(const std::string &path, const PGDClass_::Struct_PGD &struct_pgd, int group_rows,
+                              PGD_CodecMode mode) {
+	std::vector<uchar> stream;
+	if (!calc_Encode(struct_pgd, stream, group_rows, mode)) return false;
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.write(reinterpret_cast<const char *>(stream.data()), (std::streamsize) stream.size())) {
+		printf("出现异常，无法写入文件 %s\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+/*!
+ * @brief 读取文件并解压PGD结果
+ * @return PGD结果，读取失败时返回空指针
+ */
+std::unique_ptr<PGDClass_::Struct_PGD> PGDCodecClass_::load_PGD(const std::string &path) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) {
+		printf("出现异常，无法读取文件 %s\n", path.c_str());
+		return nullptr;
+	}
+	std::vector<uchar> stream((size_t) file.tellg());
+	file.seekg(0);
+	file.read(reinterpret_cast<char *>(stream.data()), (std::streamsize) stream.size());
+	return calc_Decode(stream.data(), stream.size());
+}
@@ -0,0 +1,229 @@
+
+#include <PGD_Detector.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+/// @file  PGD_Detector.cpp
+/// @brief 滑动窗口检测打分：cell直方图的线性模型，按cell位置分解为查表响应图与积分图
+
+/*!
+ * @brief 滑动窗口检测：对每个模型（窗口大小）计算所有窗口位置的得分，再做非极大值抑制
+ * @param struct_pgd PGD结果
+ * @param models 线性模型，每个模型对应一种窗口大小
+ * @param stride 窗口滑动的步长（像素）
+ * @param top_k 最多保留的结果个数，小于等于0表示不限制
+ * @param nms_iou 非极大值抑制的交并比阈值，与已保留的结果交并比大于该值的候选会被抑制
+ * @return 每个模型的得分图以及抑制后的结果（按得分从高到低）
+ * @note 不合法的模型会打印提示，其得分图为空矩阵
+ */
+PGDDetectorClass_::Struct_DetectResult
+PGDDetectorClass_::calc_Detect(const PGDClass_::Struct_PGD &struct_pgd, const std::vector<Struct_LinearModel> &models,
+                               int stride, int top_k, float nms_iou) {
+	Struct_DetectResult result;
+	std::vector<Struct_Detection> candidates;
+	std::map<int, cv::Mat> code_bins_cache;//相同code_bits的模型共用同一个bin图
+	if (stride <= 0) stride = 1;
+
+	for (int m = 0; m < (int) models.size(); ++m) {
+		const Struct_LinearModel &model = models[m];
+		size_t n_weights = 0;
+		if (model.cell_rows > 0 && model.cell_cols > 0 && model.code_bits > 0 && model.code_bits <= 16)
+			n_weights = (size_t) (model.win_rows / model.cell_rows) * (model.win_cols / model.cell_cols) *
+			            model.n_channels * ((size_t) 1 << model.code_bits);
+		if (n_weights == 0 || model.win_rows % model.cell_rows != 0 || model.win_cols % model.cell_cols != 0 ||
+		    model.n_channels != struct_pgd.PGD.channels() || model.weights.size() != n_weights) {
+			printf("出现异常，第 %d 个检测模型不合法或与PGD结果不匹配\n", m);
+			result.score_maps.emplace_back();
+			continue;
+		}
+
+		cv::Mat &code_bins = code_bins_cache[model.code_bits];
+		if (code_bins.empty()) code_bins = calc_CodeBins(struct_pgd, model.code_bits);
+		cv::Mat score_map = calc_ScoreMap(code_bins, model, stride);
+		result.score_maps.push_back(score_map);
+
+		for (int i = 0; i < score_map.rows; ++i) {
+			const float *score_row = score_map.ptr<float>(i);
+			for (int j = 0; j < score_map.cols; ++j) {
+				if (score_row[j] <= model.threshold) continue;
+				Struct_Detection detection;
+				detection.box = cv::Rect(j * stride, i * stride, model.win_cols, model.win_rows);
+				detection.score = score_row[j];
+				detection.model_index = m;
+				candidates.push_back(detection);
+			}
+		}
+	}
+	result.detections = calc_NMS(candidates, top_k, nms_iou);
+	return result;
+}
+
+/*!
+ * @brief 读取文本格式的线性模型（例如Python训练后导出的权重）
+ * @param path 文件路径
+ * @param model [输出] 模型
+ * @return 读取失败或权重个数不对时返回false
+ * @note 文件内容为空白分隔的数字：\n
+ * win_rows win_cols cell_rows cell_cols code_bits n_channels bias threshold，随后是全部权重
+ */
+bool PGDDetectorClass_::load_Model(const std::string &path, Struct_LinearModel &model) {
+	std::ifstream file(path);
+	if (!(file >> model.win_rows >> model.win_cols >> model.cell_rows >> model.cell_cols
+	           >> model.code_bits >> model.n_channels >> model.bias >> model.threshold)) {
+		printf("出现异常，无法读取检测模型 %s\n", path.c_str());
+		return false;
+	}
+	model.weights.clear();
+	float weight = 0;
+	while (file >> weight) model.weights.push_back(weight);
+	if (model.cell_rows <= 0 || model.cell_cols <= 0 || model.code_bits <= 0 || model.code_bits > 16 ||
+	    model.weights.size() != (size_t) (model.win_rows / model.cell_rows) * (model.win_cols / model.cell_cols) *
+	                            model.n_channels * ((size_t) 1 << model.code_bits)) {
+		printf("出现异常，检测模型 %s 的权重个数不正确\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+/*!
+ * @brief 把每个通道的G值折叠到code_bits位，得到直方图的bin
+ * @note G值位数不超过code_bits时bin就是G值本身；否则每code_bits位一段，各段异或
+ */
+template<typename T>
+static void calc_CodeBinsRows(const cv::Mat &PGD, cv::Mat &code_bins, int code_bits, const cv::Range &range) {
+	int n_channels = PGD.channels();
+	uint64 mask = ((uint64) 1 << code_bits) - 1;
+	for (int i = range.start; i < range.end; ++i) {
+		const T *src_row = PGD.ptr<T>(i);
+		ushort *bin_row = code_bins.ptr<ushort>(i);
+		for (int t = 0; t < PGD.cols * n_channels; ++t) {
+			uint64 G = (uint64) src_row[t];
+			uint64 bin = 0;
+			for (; G != 0; G >>= code_bits) bin ^= G & mask;
+			bin_row[t] = (ushort) bin;
+		}
+	}
+}
+
+/*!
+ * @brief 计算每个像素每个通道的直方图bin
+ * @return CV_16UC(n_sample) 类型的bin图
+ */
+cv::Mat PGDDetectorClass_::calc_CodeBins(const PGDClass_::Struct_PGD &struct_pgd, int code_bits) {
+	const cv::Mat &PGD = struct_pgd.PGD;
+	cv::Mat code_bins(PGD.rows, PGD.cols, CV_16UC(PGD.channels()));
+	cv::parallel_for_(cv::Range(0, PGD.rows), [&](const cv::Range &range) {
+		switch (PGD.elemSize1()) {
+			case 1:
+				calc_CodeBinsRows<uint8_t>(PGD, code_bins, code_bits, range);
+				break;
+			case 2:
+				calc_CodeBinsRows<uint16_t>(PGD, code_bins, code_bits, range);
+				break;
+			case 4:
+				calc_CodeBinsRows<uint32_t>(PGD, code_bins, code_bits, range);
+				break;
+			default:
+				calc_CodeBinsRows<uint64>(PGD, code_bins, code_bits, range);
+				break;
+		}
+	});
+	return code_bins;
+}
+
+/*!
+ * @brief 计算一个模型在所有窗口位置的得分
+ * @param code_bins 直方图bin图
+ * @param model 线性模型
+ * @param stride 窗口滑动的步长
+ * @return CV_32FC1 类型的得分图，图像小于窗口时为空矩阵
+ * @note 对窗口内的每个cell位置q：\n
+ * ① 逐像素查表得到响应图 M_q(p) = Σ_通道 w[q][通道][bin]\n
+ * ② 对 M_q 求积分图\n
+ * ③ 每个窗口加上 M_q 在该窗口第q个cell区域内的和（积分图四个角点）
+ */
+cv::Mat PGDDetectorClass_::calc_ScoreMap(const cv::Mat &code_bins, const Struct_LinearModel &model, int stride) {
+	int rows = code_bins.rows;
+	int cols = code_bins.cols;
+	int n_channels = code_bins.channels();
+	int out_rows = rows < model.win_rows ? 0 : (rows - model.win_rows) / stride + 1;
+	int out_cols = cols < model.win_cols ? 0 : (cols - model.win_cols) / stride + 1;
+	if (out_rows == 0 || out_cols == 0) return cv::Mat();
+
+	int cells_y = model.win_rows / model.cell_rows;
+	int cells_x = model.win_cols / model.cell_cols;
+	size_t n_bins = (size_t) 1 << model.code_bits;
+	cv::Mat score_sum(out_rows, out_cols, CV_64FC1);
+	score_sum.setTo(model.bias);
+	cv::Mat response(rows, cols, CV_64FC1);
+	cv::Mat response_integral;
+
+	for (int cy = 0; cy < cells_y; ++cy) {
+		for (int cx = 0; cx < cells_x; ++cx) {
+			const float *cell_weights = &model.weights[((size_t) cy * cells_x + cx) * n_channels * n_bins];
+			///①逐像素查表
+			cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range &range) {
+				for (int i = range.start; i < range.end; ++i) {
+					const ushort *bin_row = code_bins.ptr<ushort>(i);
+					double *response_row = response.ptr<double>(i);
+					for (int j = 0; j < cols; ++j, bin_row += n_channels) {
+						double value = 0;
+						for (int c = 0; c < n_channels; ++c) value += cell_weights[c * n_bins + bin_row[c]];
+						response_row[j] = value;
+					}
+				}
+			});
+			///②积分图
+			cv::integral(response, response_integral, CV_64F);
+			///③累加到每个窗口
+			int offset_y = cy * model.cell_rows;
+			int offset_x = cx * model.cell_cols;
+			cv::parallel_for_(cv::Range(0, out_rows), [&](const cv::Range &range) {
+				for (int i = range.start; i < range.end; ++i) {
+					int y1 = i * stride + offset_y;
+					const double *top = response_integral.ptr<double>(y1);
+					const double *bottom = response_integral.ptr<double>(y1 + model.cell_rows);
+					double *score_row = score_sum.ptr<double>(i);
+					for (int j = 0; j < out_cols; ++j) {
+						int x1 = j * stride + offset_x;
+						int x2 = x1 + model.cell_cols;
+						score_row[j] += bottom[x2] - bottom[x1] - top[x2] + top[x1];
+					}
+				}
+			});
+		}
+	}
+
+	cv::Mat score_map;
+	score_sum.convertTo(score_map, CV_32F);
+	return score_map;
+}
+
+/*!
+ * @brief 贪心的非极大值抑制
+ * @param candidates 候选结果（会被按得分排序）
+ * @param top_k 最多保留的个数，小于等于0表示不限制
+ * @param nms_iou 交并比阈值
+ * @return 保留的结果，按得分从高到低
+ */
+std::vector<PGDDetectorClass_::Struct_Detection>
+PGDDetectorClass_::calc_NMS(std::vector<Struct_Detection> &candidates, int top_k, float nms_iou) {
+	std::sort(candidates.begin(), candidates.end(),
+	          [](const Struct_Detection &a, const Struct_Detection &b) { return a.score > b.score; });
+	std::vector<Struct_Detection> kept;
+	for (const Struct_Detection &candidate : candidates) {
+		if (top_k > 0 && (int) kept.size() >= top_k) break;
+		bool suppressed = false;
+		for (const Struct_Detection &other : kept) {
+			double inter = (candidate.box & other.box).area();
+			double iou = inter / (candidate.box.area() + other.box.area() - inter);
+			if (iou > nms_iou) {
+				suppressed = true;
+				break;
+			}
+		}
+		if (!suppressed) kept.push_back(candidate);
+	}
+	return kept;
+}
@@ -0,0 +1,370 @@
+
+#include <PGD.h>
+#include <cstdlib>
+#include <string>
+
+/// @file  PGD_Dispatch.cpp
+/// @brief 热点内核（逐行遍历、汉明距离）的多指令集版本以及运行时选择
+///
+/// 内核本体只写一份（强制内联），分别包进带有 `target` 属性的函数中，由编译器按各自的指令集生成代码：
+/// x86 上有 SSE2（基线）、AVX2、AVX-512 三个版本，ARM64 上 NEON 即为基线。\n
+/// 启动后根据 cpuid 选择可用的最高版本，环境变量 PGD_ISA（sse2/avx2/avx512/neon）可以强制指定，
+/// 选择结果通过 PGDClass_::get_KernelISA() 获取。\n
+/// 整个库使用 -ffp-contract=off 编译，AVX-512 版本不会把乘加合并为FMA，因此各版本的结果逐位相同。
+/// @note 逐像素的遍历没有可以向量化的内层循环，各指令集的代码几乎相同，因此只对逐行遍历做分发。
+/// 汉明距离只有AVX2版本是向量化的（查表计数），AVX-512版本沿用AVX2的实现，512位的字节查表需要AVX-512BW，
+/// 而这里的AVX-512版本只要求AVX-512F
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PGD_DISPATCH_X86 1
+#define PGD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PGD_DISPATCH_X86 0
+#endif
+
+#if PGD_DISPATCH_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define PGD_ALWAYS_INLINE inline __attribute__((always_inline))
+#define PGD_RESTRICT __restrict__
+#else
+#define PGD_ALWAYS_INLINE inline
+#define PGD_RESTRICT
+#endif
+
+
+/*!
+ * @brief 把一整行的G值写入输出矩阵的某个通道
+ * @tparam T 每个通道的数据类型
+ * @param dst_ptr 输出行中第0列该通道的地址
+ * @param step_1 每个元素占用的字节数
+ * @param G_row 一整行的G值
+ * @param cols 列数
+ */
+template<typename T>
+static PGD_ALWAYS_INLINE void write_PGDRow(uchar *dst_ptr, size_t step_1, const uint64 *G_row, int cols) {
+	for (int jj = 0; jj < cols; ++jj, dst_ptr += step_1)
+		*reinterpret_cast<T *>(dst_ptr) = (T) G_row[jj];
+}
+
+/*!
+	 * @brief calc_N4PGD_TraverseRow 通过N4方法插值逐行遍历全图（内核本体，各指令集版本共用）
+	 * @param src 输入图像（必须是单通道，已经填充过）
+	 * @param PGD_Data 输出图像
+	 * @param struct_n4Interp 输入的带权重的参数
+	 * @note 与 calc_N4PGD_Traverse 的结果逐位相同（插值的运算顺序一致），只是交换了循环顺序：
+	 * 每一个【子环点】先对整行的中心点插值存入行缓冲区，再整行比较相邻【子环点】得到G值。
+	 * 最内层循环都是连续内存上的运算，编译器可以向量化
+	 */
+static PGD_ALWAYS_INLINE void
+calc_N4PGD_TraverseRow_Impl(const cv::Mat &src, cv::Mat &PGD_Data, const PGDClass_::Struct_N4InterpList &struct_n4Interp) {
+	int n_sample = struct_n4Interp.n_sample;
+	int n2_sample = struct_n4Interp.n2_sample;
+	int channel_size = (int) ceil((float) n2_sample / 8.0f);
+	int R = struct_n4Interp.pad;
+	int len_win = 1 + 2 * R;
+	int dst_rows = src.rows - 2 * R;
+	int dst_cols = src.cols - 2 * R;
+	size_t step_1 = PGD_Data.step[1];
+
+	std::vector<const double *> row_ptr((size_t) len_win);
+	//每个【子环点】占一行插值结果，多出的一行复制第0行，规避判断最后一位
+	std::vector<double> InterpRow((size_t) (n2_sample + 1) * dst_cols);
+	std::vector<uint64> G_row((size_t) dst_cols);
+
+	for (int ii = 0; ii < dst_rows; ++ii) {
+		//行指针偏移了R列，因此下标jj直接对应输出的列号
+		for (int t = 0; t < len_win; ++t) row_ptr[t] = src.ptr<double>(ii + t) + R;
+		uchar *dst_row = PGD_Data.ptr(ii);
+		for (int k = 0; k < n_sample; ++k) {
+			///整行插值
+			for (int l = 0; l < n2_sample; ++l) {
+				const short *dx = struct_n4Interp.arr_InterpOffsetX[k][l];
+				const short *dy = struct_n4Interp.arr_InterpOffsetY[k][l];
+				//权重先取到局部变量，行指针声明为不重叠，否则编译器不会向量化
+				const double w1 = struct_n4Interp.arr_InterpWeight[k][l][0];
+				const double w2 = struct_n4Interp.arr_InterpWeight[k][l][1];
+				const double w3 = struct_n4Interp.arr_InterpWeight[k][l][2];
+				const double w4 = struct_n4Interp.arr_InterpWeight[k][l][3];
+				const double *PGD_RESTRICT p1 = row_ptr[R + dy[0]] + dx[0];
+				const double *PGD_RESTRICT p2 = row_ptr[R + dy[1]] + dx[1];
+				const double *PGD_RESTRICT p3 = row_ptr[R + dy[2]] + dx[2];
+				const double *PGD_RESTRICT p4 = row_ptr[R + dy[3]] + dx[3];
+				double *PGD_RESTRICT interp = &InterpRow[(size_t) l * dst_cols];
+				for (int jj = 0; jj < dst_cols; ++jj)
+					interp[jj] = w1 * p1[jj] + w2 * p2[jj] + w3 * p3[jj] + w4 * p4[jj];
+			}
+			std::copy(InterpRow.begin(), InterpRow.begin() + dst_cols, InterpRow.begin() + (size_t) n2_sample * dst_cols);
+			///整行比较，计算G值
+			std::fill(G_row.begin(), G_row.end(), 0);
+			for (int l = 0; l < n2_sample; ++l) {
+				const double *PGD_RESTRICT a = &InterpRow[(size_t) l * dst_cols];
+				const double *PGD_RESTRICT b = a + dst_cols;
+				uint64 *PGD_RESTRICT G = G_row.data();
+				for (int jj = 0; jj < dst_cols; ++jj)
+					G[jj] |= (uint64) (a[jj] > b[jj]) << l;
+			}
+			uchar *dst_ptr = dst_row + k * channel_size;
+			switch (channel_size) {
+				case 1:
+					write_PGDRow<uint8_t>(dst_ptr, step_1, G_row.data(), dst_cols);
+					break;
+				case 2:
+					write_PGDRow<uint16_t>(dst_ptr, step_1, G_row.data(), dst_cols);
+					break;
+				case 4:
+					write_PGDRow<uint32_t>(dst_ptr, step_1, G_row.data(), dst_cols);
+					break;
+				default:
+					write_PGDRow<uint64>(dst_ptr, step_1, G_row.data(), dst_cols);
+					break;
+			}
+		}
+	}
+}
+
+/*!
+	 * @brief calc_44IntPGD_TraverseRow 逐行遍历全图 (不插值)（内核本体，各指令集版本共用）
+	 * @param src 输入图像（必须是单通道，已经填充过）
+	 * @param PGD_Data 输出图像
+	 * @param struct_n4Interp 输入的带权重的参数
+	 * @note 与 calc_44IntPGD_Traverse 的结果相同，4个【子环点】直接取整行的行指针，整行比较
+	 */
+static PGD_ALWAYS_INLINE void
+calc_44IntPGD_TraverseRow_Impl(const cv::Mat &src, cv::Mat &PGD_Data, const PGDClass_::Struct_N4InterpList &struct_n4Interp) {
+	const int n_sample = 4;
+	int R = struct_n4Interp.pad;
+	int len_win = 1 + 2 * R;
+	int dst_rows = src.rows - 2 * R;
+	int dst_cols = src.cols - 2 * R;
+	size_t step_1 = PGD_Data.step[1];
+	std::vector<const double *> row_ptr((size_t) len_win);
+
+	for (int ii = 0; ii < dst_rows; ++ii) {
+		for (int t = 0; t < len_win; ++t) row_ptr[t] = src.ptr<double>(ii + t) + R;
+		uchar *dst_row = PGD_Data.ptr(ii);
+		for (int k = 0; k < n_sample; ++k) {
+			const double *PGD_RESTRICT p0 = row_ptr[R + struct_n4Interp.arr_44IntOffsetY[k][0]] + struct_n4Interp.arr_44IntOffsetX[k][0];
+			const double *PGD_RESTRICT p1 = row_ptr[R + struct_n4Interp.arr_44IntOffsetY[k][1]] + struct_n4Interp.arr_44IntOffsetX[k][1];
+			const double *PGD_RESTRICT p2 = row_ptr[R + struct_n4Interp.arr_44IntOffsetY[k][2]] + struct_n4Interp.arr_44IntOffsetX[k][2];
+			const double *PGD_RESTRICT p3 = row_ptr[R + struct_n4Interp.arr_44IntOffsetY[k][3]] + struct_n4Interp.arr_44IntOffsetX[k][3];
+			uchar *dst_ptr = dst_row + k;
+			for (int jj = 0; jj < dst_cols; ++jj, dst_ptr += step_1)
+				*dst_ptr = (uchar) ((p0[jj] > p1[jj]) | (p1[jj] > p2[jj]) << 1 | (p2[jj] > p3[jj]) << 2 | (p3[jj] > p0[jj]) << 3);
+		}
+	}
+}
+
+/*!
+ * @brief 两个PGD结果的一整行逐元素求汉明距离（内核本体，各指令集版本共用）
+ * @tparam W 按多宽的字读取，每个元素的字节数必须是W的整数倍
+ * @param a 第一个结果的行指针
+ * @param b 第二个结果的行指针
+ * @param dst 输出的距离
+ * @param cols 列数
+ * @param n_words 每个元素包含的字数
+ * @note 通道的高位在写入时为0，因此直接对整个元素异或后计数即可
+ */
+template<typename W>
+static PGD_ALWAYS_INLINE void
+calc_HammingRow_Words(const uchar *a, const uchar *b, int *PGD_RESTRICT dst, int cols, int n_words) {
+	const W *PGD_RESTRICT pa = reinterpret_cast<const W *>(a);
+	const W *PGD_RESTRICT pb = reinterpret_cast<const W *>(b);
+	for (int jj = 0; jj < cols; ++jj) {
+		int count = 0;
+		for (int w = 0; w < n_words; ++w, ++pa, ++pb)
+			count += __builtin_popcountll((unsigned long long) (*pa ^ *pb));
+		dst[jj] = count;
+	}
+}
+
+static PGD_ALWAYS_INLINE void
+calc_HammingRow_Impl(const uchar *a, const uchar *b, int *dst, int cols, int elem_size) {
+	if (elem_size % 8 == 0)
+		calc_HammingRow_Words<uint64_t>(a, b, dst, cols, elem_size / 8);
+	else if (elem_size % 4 == 0)
+		calc_HammingRow_Words<uint32_t>(a, b, dst, cols, elem_size / 4);
+	else if (elem_size % 2 == 0)
+		calc_HammingRow_Words<uint16_t>(a, b, dst, cols, elem_size / 2);
+	else
+		calc_HammingRow_Words<uint8_t>(a, b, dst, cols, elem_size);
+}
+
+/*!
+ * @struct Struct_KernelTable
+ * @brief 某一指令集版本的内核函数表
+ */
+struct Struct_KernelTable {
+	const char *isa;
+	void (*N4_TraverseRow)(const cv::Mat &, cv::Mat &, const PGDClass_::Struct_N4InterpList &);
+	void (*Int44_TraverseRow)(const cv::Mat &, cv::Mat &, const PGDClass_::Struct_N4InterpList &);
+	void (*HammingRow)(const uchar *, const uchar *, int *, int, int);
+};
+
+#if PGD_DISPATCH_X86
+
+static void calc_N4PGD_TraverseRow_SSE2(const cv::Mat &src, cv::Mat &PGD_Data, const PGDClass_::Struct_N4InterpList &struct_n4Interp) {
+	calc_N4PGD_TraverseRow_Impl(src, PGD_Data, struct_n4Interp);
+}
+
+static void calc_44IntPGD_TraverseRow_SSE2(const cv::Mat &src, cv::Mat &PGD_Data, const PGDClass_::Struct_N4InterpList &struct_n4Interp) {
+	calc_44IntPGD_TraverseRow_Impl(src, PGD_Data, struct_n4Interp);
+}
+
+PGD_TARGET("avx2")
+static void calc_N4PGD_TraverseRow_AVX2(const cv::Mat &src, cv::Mat &PGD_Data, const PGDClass_::Struct_N4InterpList &struct_n4Interp) {
+	calc_N4PGD_TraverseRow_Impl(src, PGD_Data, struct_n4Interp);
+}
+
+PGD_TARGET("avx2")
+static void calc_44IntPGD_TraverseRow_AVX2(const cv::Mat &src, cv::Mat &PGD_Data, const PGDClass_::Struct_N4InterpList &struct_n4Interp) {
+	calc_44IntPGD_TraverseRow_Impl(src, PGD_Data, struct_n4Interp);
+}
+
+PGD_TARGET("avx512f")
+static void calc_N4PGD_TraverseRow_AVX512(const cv::Mat &src, cv::Mat &PGD_Data, const PGDClass_::Struct_N4InterpList &struct_n4Interp) {
+	calc_N4PGD_TraverseRow_Impl(src, PGD_Data, struct_n4Interp);
+}
+
+PGD_TARGET("avx512f")
+static void calc_44IntPGD_TraverseRow_AVX512(const cv::Mat &src, cv::Mat &PGD_Data, const PGDClass_::Struct_N4InterpList &struct_n4Interp) {
+	calc_44IntPGD_TraverseRow_Impl(src, PGD_Data, struct_n4Interp);
+}
+
+static void calc_HammingRow_SSE2(const uchar *a, const uchar *b, int *dst, int cols, int elem_size) {
+	calc_HammingRow_Impl(a, b, dst, cols, elem_size);
+}
+
+/*!
+ * @brief 汉明距离的AVX2版本：每次取32字节异或，按半字节查表（vpshufb）得到每个字节的置位数，再按元素横向求和
+ * @note 元素为4字节时用 maddubs/madd 两级相加，正好每个元素一个32位的和；8字节及以上用 sad 得到每8字节的和，
+ * 再累加到所属的元素。元素的字节数都是2的幂，32字节的块不会跨越小于32字节的元素，不足32字节的行尾用标量版本
+ */
+PGD_TARGET("avx2,popcnt")
+static void calc_HammingRow_AVX2(const uchar *a, const uchar *b, int *dst, int cols, int elem_size) {
+	if (elem_size < 4 || (elem_size & (elem_size - 1)) != 0) {
+		calc_HammingRow_Impl(a, b, dst, cols, elem_size);
+		return;
+	}
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+	                                        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_mask = _mm256_set1_epi8(0x0f);
+	const __m256i ones_8 = _mm256_set1_epi8(1);
+	const __m256i ones_16 = _mm256_set1_epi16(1);
+	const size_t n_bytes = (size_t) cols * elem_size;
+	size_t pos = 0;
+	if (elem_size >= 8)
+		for (int jj = 0; jj < cols; ++jj) dst[jj] = 0;
+	for (; pos + 32 <= n_bytes; pos += 32) {
+		__m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + pos)),
+		                             _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + pos)));
+		__m256i count = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(x, low_mask)),
+		                                _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask)));
+		if (elem_size == 4) {
+			__m256i sum = _mm256_madd_epi16(_mm256_maddubs_epi16(count, ones_8), ones_16);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + pos / 4), sum);
+		} else {
+			alignas(32) uint64_t sum[4];
+			_mm256_store_si256(reinterpret_cast<__m256i *>(sum), _mm256_sad_epu8(count, _mm256_setzero_si256()));
+			for (int k = 0; k < 4; ++k)
+				dst[(pos + 8 * k) / elem_size] += (int) sum[k];
+		}
+	}
+	if (pos < n_bytes)
+		calc_HammingRow_Impl(a + pos, b + pos, dst + pos / elem_size, (int) ((n_bytes - pos) / elem_size), elem_size);
+}
+
+static const Struct_KernelTable kernel_tables[] = {
+		{"sse2",   &calc_N4PGD_TraverseRow_SSE2,   &calc_44IntPGD_TraverseRow_SSE2,   &calc_HammingRow_SSE2},
+		{"avx2",   &calc_N4PGD_TraverseRow_AVX2,   &calc_44IntPGD_TraverseRow_AVX2,   &calc_HammingRow_AVX2},
+		{"avx512", &calc_N4PGD_TraverseRow_AVX512, &calc_44IntPGD_TraverseRow_AVX512, &calc_HammingRow_AVX2}
+};
+
+///当前CPU是否支持第i个版本
+static bool get_KernelSupported(int i) {
+	__builtin_cpu_init();
+	switch (i) {
+		case 0:
+			return true;
+		case 1:
+			return __builtin_cpu_supports("avx2");
+		case 2:
+			return __builtin_cpu_supports("avx512f");
+		default:
+			return false;
+	}
+}
+
+#else
+
+static void calc_N4PGD_TraverseRow_Base(const cv::Mat &src, cv::Mat &PGD_Data, const PGDClass_::Struct_N4InterpList &struct_n4Interp) {
+	calc_N4PGD_TraverseRow_Impl(src, PGD_Data, struct_n4Interp);
+}
+
+static void calc_44IntPGD_TraverseRow_Base(const cv::Mat &src, cv::Mat &PGD_Data, const PGDClass_::Struct_N4InterpList &struct_n4Interp) {
+	calc_44IntPGD_TraverseRow_Impl(src, PGD_Data, struct_n4Interp);
+}
+
+static void calc_HammingRow_Base(const uchar *a, const uchar *b, int *dst, int cols, int elem_size) {
+	calc_HammingRow_Impl(a, b, dst, cols, elem_size);
+}
+
+static const Struct_KernelTable kernel_tables[] = {
+#if defined(__aarch64__) || defined(__ARM_NEON)
+		{"neon",   &calc_N4PGD_TraverseRow_Base,   &calc_44IntPGD_TraverseRow_Base,   &calc_HammingRow_Base}
+#else
+		{"scalar", &calc_N4PGD_TraverseRow_Base,   &calc_44IntPGD_TraverseRow_Base,   &calc_HammingRow_Base}
+#endif
+};
+
+static bool get_KernelSupported(int i) {
+	return i == 0;
+}
+
+#endif
+
+/*!
+ * @brief 选择内核版本：默认为当前CPU支持的最高版本，环境变量 PGD_ISA 可以指定
+ * @note 只在第一次调用时选择一次；指定的版本不存在或当前CPU不支持时，打印提示并使用默认版本
+ */
+static const Struct_KernelTable &get_KernelTable() {
+	static const Struct_KernelTable &table = []() -> const Struct_KernelTable & {
+		const int n_tables = (int) (sizeof(kernel_tables) / sizeof(kernel_tables[0]));
+		int best = 0;
+		for (int i = 0; i < n_tables; ++i)
+			if (get_KernelSupported(i)) best = i;
+		const char *env = std::getenv("PGD_ISA");
+		if (env != nullptr && env[0] != '\0') {
+			for (int i = 0; i < n_tables; ++i) {
+				if (std::string(env) != kernel_tables[i].isa) continue;
+				if (get_KernelSupported(i)) return kernel_tables[i];
+				printf("PGD_ISA=%s 当前CPU不支持，使用 %s\n", env, kernel_tables[best].isa);
+				return kernel_tables[best];
+			}
+			printf("PGD_ISA=%s 不存在，使用 %s\n", env, kernel_tables[best].isa);
+		}
+		return kernel_tables[best];
+	}();
+	return table;
+}
+
+/*!
+ * @brief 当前使用的内核指令集版本（sse2/avx2/avx512/neon/scalar）
+ */
+const char *PGDClass_::get_KernelISA() {
+	return get_KernelTable().isa;
+}
+
+void PGDClass_::calc_N4PGD_TraverseRow(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp) {
+	get_KernelTable().N4_TraverseRow(src, PGD_Data, struct_n4Interp);
+}
+
+void PGDClass_::calc_44IntPGD_TraverseRow(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp) {
+	get_KernelTable().Int44_TraverseRow(src, PGD_Data, struct_n4Interp);
+}
+
+void PGDClass_::calc_HammingRow(const uchar *a, const uchar *b, int *dst, int cols, int elem_size) {
+	get_KernelTable().HammingRow(a, b, dst, cols, elem_size);
+}
@@ -0,0 +1,137 @@
+
+#include <PGD.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/// @file  PGD_Memory.cpp
+/// @brief 内存分配策略：输出内存与工作缓冲区按计算的行带划分并行首次写入，可选透明大页
+///
+/// 缓冲区仍由 cv::Mat 分配和释放（大块内存由glibc直接mmap，页面在第一次写入前不占用物理内存），
+/// 这里只在分配之后、使用之前决定页面落在哪里：先对整页的部分调用 madvise(MADV_HUGEPAGE)，
+/// 再按 calc_ParallelTraverse 的行带划分，由OpenCV的线程池并行地给每一页写入一个字节。
+/// 之前已经被写入过的内存无法再改变位置，此时策略记为 PGD_Mem_Plain：小于glibc的mmap阈值（动态调整，最大32MB）的缓冲区
+/// 在反复调用时通常复用堆上的空闲块，页面的位置沿用上一次的写入。
+
+
+static std::atomic<int> context_policy(PGDClass_::PGD_Mem_Default);///<set_MemPolicy() 设置的全局策略
+
+/*!
+ * @brief 设置全局的分配策略，对 mem_policy 为 PGD_Mem_Default 的 Struct_PGD 生效
+ * @param policy 策略，PGD_Mem_Default 表示恢复为由环境变量 PGD_MEMPOLICY 决定
+ * @note 输出内存在构造 Struct_PGD 时分配，已经构造好的结构体不受影响
+ */
+void PGDClass_::set_MemPolicy(PGD_MemPolicy policy) {
+	context_policy = policy;
+}
+
+/*!
+ * @brief 策略的名称，用于输出信息
+ */
+const char *PGDClass_::get_MemPolicyName(PGD_MemPolicy policy) {
+	switch (policy) {
+		case PGD_Mem_Plain:
+			return "plain";
+		case PGD_Mem_FirstTouch:
+			return "firsttouch";
+		case PGD_Mem_HugePage:
+			return "hugepage";
+		default:
+			return "default";
+	}
+}
+
+/*!
+ * @brief 确定实际请求的策略：结构体中的策略 → set_MemPolicy() 设置的策略 → 环境变量 PGD_MEMPOLICY → PGD_Mem_Plain
+ */
+PGDClass_::PGD_MemPolicy PGDClass_::calc_MemPolicy(PGD_MemPolicy mem_policy) {
+	if (mem_policy != PGD_Mem_Default) return mem_policy;
+	PGD_MemPolicy policy = (PGD_MemPolicy) context_policy.load();
+	if (policy != PGD_Mem_Default) return policy;
+	const char *env = std::getenv("PGD_MEMPOLICY");
+	if (env == nullptr) return PGD_Mem_Plain;
+	std::string value(env);
+	if (value == "firsttouch") return PGD_Mem_FirstTouch;
+	if (value == "hugepage") return PGD_Mem_HugePage;
+	return PGD_Mem_Plain;
+}
+
+/*!
+ * @brief 行带高度，与 calc_ParallelTraverse 的划分相同
+ * @param config 执行配置，band_rows 大于0时直接使用，否则按线程数的4倍划分
+ * @param rows 输出行数
+ */
+int PGDClass_::calc_BandRows(const Struct_ExecConfig &config, int rows) {
+	if (config.band_rows > 0) return config.band_rows;
+	int n_threads = config.n_threads > 0 ? config.n_threads : cv::getNumThreads();
+	return std::max(1, rows / (4 * std::max(1, n_threads)));
+}
+
+/*!
+ * @brief 按分配策略创建矩阵（内容未初始化）
+ * @param rows 行数
+ * @param cols 列数
+ * @param type 像素类型
+ * @param mem_policy 请求的策略，PGD_Mem_Default 时按 calc_MemPolicy() 确定
+ * @param config 计算时的执行配置，决定并行写入的行带划分
+ * @param pad 上下填充的行数：矩阵的第 pad 行对应输出的第0行，第一个和最后一个行带分别包含上下的填充
+ * @param mem_applied [输出] 实际生效的策略：非Linux平台或内存已经被写入过时为 PGD_Mem_Plain，
+ * madvise失败（内核不支持透明大页）时由 PGD_Mem_HugePage 降为 PGD_Mem_FirstTouch
+ * @return 矩阵
+ * @note 计算时的行带由OpenCV的线程池动态分配，同一个行带不保证由写入它的线程计算，
+ * 但是行带与线程都分散在各个节点上，访问基本是本地的
+ */
+cv::Mat PGDClass_::def_PolicyMat(int rows, int cols, int type, PGD_MemPolicy mem_policy, const Struct_ExecConfig &config,
+                                 int pad, PGD_MemPolicy &mem_applied) {
+	cv::Mat dst(rows, cols, type);
+	mem_applied = PGD_Mem_Plain;
+	PGD_MemPolicy policy = calc_MemPolicy(mem_policy);
+	if (policy == PGD_Mem_Plain || dst.empty()) return dst;
+#ifdef __linux__
+	///①只处理完整落在矩阵内的页，矩阵首尾所在的页与分配器的其他数据共用
+	size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	uintptr_t first_page = ((uintptr_t) dst.data + page - 1) / page * page;
+	uintptr_t last_page = ((uintptr_t) dst.data + dst.step[0] * rows) / page * page;
+	if (last_page <= first_page) return dst;
+	size_t n_pages = (last_page - first_page) / page;
+
+	///②已经有页面驻留说明这块内存被使用过，页面的位置已经确定
+	std::vector<unsigned char> resident(n_pages);
+	if (mincore((void *) first_page, last_page - first_page, resident.data()) != 0) return dst;
+	for (unsigned char flag : resident)
+		if (flag & 1) return dst;
+
+	///③透明大页（必须在第一次写入之前）
+	mem_applied = PGD_Mem_FirstTouch;
+#ifdef MADV_HUGEPAGE
+	if (policy == PGD_Mem_HugePage && madvise((void *) first_page, last_page - first_page, MADV_HUGEPAGE) == 0)
+		mem_applied = PGD_Mem_HugePage;
+#endif
+
+	///④按行带并行写入：每一页由其首地址所在的行带写入
+	int out_rows = rows - 2 * pad;
+	if (out_rows <= 0) {
+		out_rows = rows;
+		pad = 0;
+	}
+	int band_rows = calc_BandRows(config, out_rows);
+	int n_bands = (out_rows + band_rows - 1) / band_rows;
+	cv::parallel_for_(cv::Range(0, n_bands), [&](const cv::Range &range) {
+		for (int b = range.start; b < range.end; ++b) {
+			int row_begin = b == 0 ? 0 : pad + b * band_rows;
+			int row_end = b == n_bands - 1 ? rows : pad + (b + 1) * band_rows;
+			uintptr_t begin = std::max(first_page, ((uintptr_t) dst.ptr(row_begin) + page - 1) / page * page);
+			uintptr_t end = std::min(last_page, (uintptr_t) dst.data + dst.step[0] * row_end);
+			for (uintptr_t p = begin; p < end; p += page) *reinterpret_cast<volatile uchar *>(p) = 0;
+		}
+	}, config.n_threads > 0 ? std::min(n_bands, config.n_threads) : n_bands);
+#endif
+	return dst;
+}
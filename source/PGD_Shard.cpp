@@ -0,0 +1,372 @@
+
+#include <PGD_Shard.h>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/// @file  PGD_Shard.cpp
+/// @brief 多进程分片计算：输出文件的创建与映射、分片的调度与重试、完成清单
+
+#define PGD_SHARD_DATA_OFFSET 4096 ///<输出文件中PGD数据的起始位置（一页，保证映射后数据按页对齐）
+#define PGD_SHARD_POLL_US 2000 ///<协调进程检查子进程状态的间隔（微秒）
+
+/*!
+ * @struct Struct_ShardFileHeader
+ * @brief 输出文件头
+ */
+struct Struct_ShardFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t rows;
+	uint32_t cols;
+	uint32_t n_sample;
+	uint32_t n2_sample;
+	int32_t type;
+	uint32_t reserved;
+	uint64 step;
+	uint64 data_offset;
+};
+
+#if defined(__linux__)
+
+/*!
+ * @brief 输入内容的校验和（逐行按64位字的FNV-1a），用于发现续算时输入图像已被替换
+ * @note 只读一遍输入，与分片计算相比可以忽略
+ */
+static uint64 get_Checksum(const cv::Mat &src) {
+	const uint64 prime = 0x100000001b3ull;
+	uint64 hash = 0xcbf29ce484222325ull;
+	size_t row_bytes = src.cols * src.elemSize();
+	for (int i = 0; i < src.rows; ++i) {
+		const uchar *row_ptr = src.ptr(i);
+		size_t k = 0;
+		for (; k + 8 <= row_bytes; k += 8) {
+			uint64 word;
+			memcpy(&word, row_ptr + k, 8);
+			hash = (hash ^ word) * prime;
+		}
+		for (; k < row_bytes; ++k) hash = (hash ^ row_ptr[k]) * prime;
+	}
+	return hash;
+}
+
+///清单第一行的参数签名（包括输入的类型与内容校验和），参数或输入不同的清单不能续算
+static std::string get_Signature(const cv::Mat &src, int n_sample, int n2_sample, double radius, double radius_2,
+                                 const PGDShardClass_::Struct_ShardConfig &config) {
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "%d %d %d %d %.17g %.17g %d %.17g %llu %d %016llx", src.rows, src.cols, n_sample,
+	         n2_sample, radius, radius_2, (int) config.sample_mode, config.flat_threshold,
+	         (unsigned long long) config.flat_code, src.type(), (unsigned long long) get_Checksum(src));
+	return buffer;
+}
+
+PGDShardClass_::Struct_MappedPGD::~Struct_MappedPGD() {
+	struct_pgd.reset();
+	if (map_ptr != nullptr) munmap(map_ptr, map_size);
+}
+
+/*!
+ * @brief 多进程分片计算，结果写入内存映射的输出文件
+ * @param src 输入的矩阵（子进程通过fork共享，不复制）
+ * @param path 输出文件路径，清单文件为 path + ".manifest"
+ * @param n_sample 【环点】数
+ * @param n2_sample 【子环点】数
+ * @param radius 【环点】半径大小（浮点数）
+ * @param radius_2 【环点】周围的【子环点】计算范围，为0时等于radius
+ * @param config 分片配置
+ * @return 统计结果，ok为true时输出文件完整
+ * @note ① 清单存在且参数签名（含输入的类型与内容校验和）相同时续算，只计算清单中没有的分片；否则重新创建输出文件\n
+ * ② 每个分片的输入带上下各R行边缘（图像边缘处按原方法复制填充），输出与单进程计算逐位相同；
+ * 设置了平坦阈值时，分片行数向上取整为 PGD_FLAT_BAND_ROWS 的倍数，分片的平坦掩码与整幅图像的行带对齐
+ * （区域均值采样时积分图的起点不同，个别平局的比较可能不同）\n
+ * ③ 子进程把结果msync落盘后正常退出，协调进程才在清单中记录该分片；子进程异常退出或被杀死时分片重新排队
+ */
+PGDShardClass_::Struct_ShardReport
+PGDShardClass_::calc_PGDFilterSharded(const cv::Mat &src, const std::string &path, PGDClass_::PGD_SampleNums n_sample,
+                                      PGDClass_::PGD_SampleNums n2_sample, double radius, double radius_2,
+                                      const Struct_ShardConfig &config) {
+	Struct_ShardReport report;
+	if (src.empty()) {
+		printf("出现异常，calc_PGDFilterSharded 的输入图像为空\n");
+		return report;
+	}
+	int rows = src.rows;
+	int cols = src.cols;
+	int n_workers = config.n_workers > 0 ? config.n_workers : std::max(1, cv::getNumberOfCPUs());
+	std::string manifest_path = path + ".manifest";
+	std::string signature = get_Signature(src, n_sample, n2_sample, radius, radius_2, config);
+
+	///①读取清单，判断能否续算
+	//平坦掩码的行带按整幅图像的行号划分，分片边界与行带边界对齐时，分片内的滑动求和与单进程计算完全相同
+	int shard_align = config.flat_threshold > 0 ? PGD_FLAT_BAND_ROWS : 1;
+	int shard_rows = (config.shard_rows + shard_align - 1) / shard_align * shard_align;
+	std::vector<std::pair<int, int>> done_list;
+	bool resume = false;
+	{
+		std::ifstream manifest(manifest_path);
+		std::string line, tag;
+		int file_shard_rows = 0;
+		if (std::getline(manifest, line)) {
+			std::istringstream header(line);
+			std::string file_signature;
+			if (header >> tag >> file_shard_rows && std::getline(header >> std::ws, file_signature) &&
+			    tag == "PGD_SHARD" && file_signature == signature && file_shard_rows > 0 &&
+			    file_shard_rows % shard_align == 0 && (shard_rows <= 0 || shard_rows == file_shard_rows)) {
+				resume = true;
+				shard_rows = file_shard_rows;
+			}
+		}
+		while (resume && std::getline(manifest, line)) {
+			std::istringstream entry(line);
+			int index = 0, row_begin = 0;
+			if (entry >> tag >> index >> row_begin && tag == "done") done_list.emplace_back(index, row_begin);
+		}
+	}
+	std::unique_ptr<Struct_MappedPGD> mapped;
+	if (resume) {
+		mapped = load_MappedPGD(path, true);
+		resume = mapped && mapped->struct_pgd->rows == rows && mapped->struct_pgd->cols == cols &&
+		         mapped->struct_pgd->n_sample == n_sample && mapped->struct_pgd->n2_sample == n2_sample;
+	}
+	if (!resume) {
+		done_list.clear();
+		if (shard_rows <= 0) {
+			shard_rows = std::max(1, (rows + 4 * n_workers - 1) / (4 * n_workers));
+			shard_rows = (shard_rows + shard_align - 1) / shard_align * shard_align;
+		}
+		mapped = def_MappedFile(path, rows, cols, n_sample, n2_sample);
+		FILE *manifest = fopen(manifest_path.c_str(), "w");
+		if (!mapped || manifest == nullptr) {
+			printf("出现异常，无法创建输出文件 %s 或清单文件\n", path.c_str());
+			if (manifest != nullptr) fclose(manifest);
+			return report;
+		}
+		fprintf(manifest, "PGD_SHARD %d %s\n", shard_rows, signature.c_str());
+		fflush(manifest);
+		fsync(fileno(manifest));
+		fclose(manifest);
+	}
+
+	int n_shards = (rows + shard_rows - 1) / shard_rows;
+	std::vector<char> done((size_t) n_shards, 0);
+	for (const std::pair<int, int> &entry : done_list)
+		if (entry.first >= 0 && entry.first < n_shards && entry.second == entry.first * shard_rows) done[entry.first] = 1;
+	report.n_shards = n_shards;
+
+	PGDClass_::Struct_PGD &struct_dst = *mapped->struct_pgd;
+	struct_dst.sample_mode = config.sample_mode;
+	struct_dst.flat_threshold = config.flat_threshold;
+	struct_dst.flat_code = config.flat_code;
+
+	///②调度：最多n_workers个子进程，失败的分片重新排队
+	std::deque<int> pending;
+	for (int s = 0; s < n_shards; ++s) {
+		if (done[s]) ++report.n_resumed;
+		else pending.push_back(s);
+	}
+	FILE *manifest = fopen(manifest_path.c_str(), "a");
+	if (manifest == nullptr) {
+		printf("出现异常，无法写入清单文件 %s\n", manifest_path.c_str());
+		return report;
+	}
+	std::vector<int> attempts((size_t) n_shards, 0);
+	std::vector<std::pair<pid_t, int>> running;
+	while (!pending.empty() || !running.empty()) {
+		while ((int) running.size() < n_workers && !pending.empty()) {
+			int shard = pending.front();
+			int row_begin = shard * shard_rows;
+			int row_end = std::min(rows, row_begin + shard_rows);
+			fflush(stdout);
+			fflush(manifest);
+			pid_t pid = fork();
+			if (pid == 0) {
+				//fork只复制当前线程，父进程中OpenCV线程池的线程在子进程里不存在，
+				//预处理（类型转换、平坦掩码）和遍历中的 parallel_for_ 之前先设置子进程自己的线程数
+				cv::setNumThreads(std::max(1, config.exec_config.n_threads));
+				//子进程不能执行父进程的析构函数与atexit（其中可能有等待其他线程的操作）
+				bool ok = calc_Shard(src, struct_dst, row_begin, row_end, radius, radius_2, config);
+				_exit(ok ? 0 : 1);
+			}
+			if (pid < 0) {
+				printf("出现异常，fork失败：%s\n", strerror(errno));
+				break;
+			}
+			pending.pop_front();
+			++attempts[shard];
+			running.emplace_back(pid, shard);
+		}
+		if (running.empty()) break;//无法创建任何子进程
+
+		usleep(PGD_SHARD_POLL_US);
+		for (size_t r = 0; r < running.size();) {
+			int status = 0;
+			pid_t pid = waitpid(running[r].first, &status, WNOHANG);
+			if (pid == 0) {
+				++r;
+				continue;
+			}
+			int shard = running[r].second;
+			running.erase(running.begin() + (long) r);
+			if (pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+				fprintf(manifest, "done %d %d %d\n", shard, shard * shard_rows, std::min(rows, (shard + 1) * shard_rows));
+				fflush(manifest);
+				fsync(fileno(manifest));
+				++report.n_computed;
+			} else if (attempts[shard] <= config.max_retries) {
+				printf("出现异常，分片 %d 计算失败，重新排队（第 %d 次重试）\n", shard, attempts[shard]);
+				pending.push_back(shard);
+				++report.n_retries;
+			} else {
+				printf("出现异常，分片 %d 重试 %d 次后仍然失败\n", shard, config.max_retries);
+				++report.n_failed;
+			}
+		}
+	}
+	fclose(manifest);
+	report.ok = report.n_resumed + report.n_computed == n_shards;
+	return report;
+}
+
+/*!
+ * @brief 映射一个输出文件
+ * @param path 文件路径
+ * @param writable 是否可写（只读映射的数据不能修改）
+ * @return 映射结果，文件不存在、格式不对或大小不足时为空
+ */
+std::unique_ptr<PGDShardClass_::Struct_MappedPGD> PGDShardClass_::load_MappedPGD(const std::string &path, bool writable) {
+	int fd = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+	if (fd < 0) return nullptr;
+	Struct_ShardFileHeader header;
+	struct stat file_stat;
+	bool ok = fstat(fd, &file_stat) == 0 && pread(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header) &&
+	          memcmp(header.magic, "PGDM", 4) == 0 && header.version == 1 &&
+	          header.type == PGDClass_::def_DstType((PGDClass_::PGD_SampleNums) header.n_sample,
+	                                                (PGDClass_::PGD_SampleNums) header.n2_sample) &&
+	          header.step >= header.cols * (uint64) CV_ELEM_SIZE(header.type) &&
+	          (uint64) file_stat.st_size >= header.data_offset + header.rows * header.step;
+	if (!ok) {
+		printf("出现异常，%s 不是完整的PGD映射文件\n", path.c_str());
+		close(fd);
+		return nullptr;
+	}
+	std::unique_ptr<Struct_MappedPGD> mapped(new Struct_MappedPGD);
+	mapped->map_size = (size_t) (header.data_offset + header.rows * header.step);
+	void *map_ptr = mmap(nullptr, mapped->map_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map_ptr == MAP_FAILED) {
+		printf("出现异常，无法映射 %s：%s\n", path.c_str(), strerror(errno));
+		return nullptr;
+	}
+	mapped->map_ptr = map_ptr;
+	mapped->struct_pgd.reset(new PGDClass_::Struct_PGD((int) header.rows, (int) header.cols,
+	                                                   (PGDClass_::PGD_SampleNums) header.n_sample,
+	                                                   (PGDClass_::PGD_SampleNums) header.n2_sample,
+	                                                   (uchar *) map_ptr + header.data_offset, (size_t) header.step));
+	return mapped;
+}
+
+/*!
+ * @brief 创建（覆盖）输出文件并映射
+ */
+std::unique_ptr<PGDShardClass_::Struct_MappedPGD>
+PGDShardClass_::def_MappedFile(const std::string &path, int rows, int cols, PGDClass_::PGD_SampleNums n_sample,
+                               PGDClass_::PGD_SampleNums n2_sample) {
+	Struct_ShardFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "PGDM", 4);
+	header.version = 1;
+	header.rows = (uint32_t) rows;
+	header.cols = (uint32_t) cols;
+	header.n_sample = (uint32_t) n_sample;
+	header.n2_sample = (uint32_t) n2_sample;
+	header.type = PGDClass_::def_DstType(n_sample, n2_sample);
+	header.step = (uint64) cols * CV_ELEM_SIZE(header.type);
+	header.data_offset = PGD_SHARD_DATA_OFFSET;
+
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return nullptr;
+	bool ok = ftruncate(fd, (off_t) (header.data_offset + header.rows * header.step)) == 0 &&
+	          pwrite(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header);
+	close(fd);
+	if (!ok) return nullptr;
+	return load_MappedPGD(path, true);
+}
+
+/*!
+ * @brief 子进程中计算一个分片
+ * @param src 整幅输入图像
+ * @param struct_dst 映射的输出（其中的采样方式与平坦阈值由协调进程设置）
+ * @param row_begin 分片的第一行
+ * @param row_end 分片的最后一行（不含）
+ * @note 输入取分片上下各R行（到图像边缘为止），预处理只对这一段做；
+ * 遍历时跳过填充出来的边缘行，只写分片自己的行，最后msync落盘
+ */
+bool PGDShardClass_::calc_Shard(const cv::Mat &src, PGDClass_::Struct_PGD &struct_dst, int row_begin, int row_end,
+                                double radius, double radius_2, const Struct_ShardConfig &config) {
+	//与 calc_PrepareN4 中的填充大小相同
+	double r2 = radius_2 == 0 ? radius : radius_2;
+	int n2_sample = struct_dst.n2_sample == PGDClass_::PGD_SampleNums_SameAs_N_Sample ? struct_dst.n_sample : struct_dst.n2_sample;
+	int R = (int) ceil(radius + r2);
+	if (config.sample_mode == PGDClass_::PGD_Sample_BoxIntegral) R += PGDClass_::calc_BoxHalfSize(n2_sample, r2) + 1;
+
+	int halo_top = std::min(R, row_begin);
+	int halo_bottom = std::min(R, src.rows - row_end);
+	cv::Mat src_shard = src.rowRange(row_begin - halo_top, row_end + halo_bottom);
+	cv::Mat src_double, flat_mask;
+	std::unique_ptr<PGDClass_::Struct_N4InterpList> struct_n4Interp =
+			PGDClass_::calc_PrepareN4(src_shard, struct_dst, radius, radius_2, src_double, &flat_mask, nullptr,
+			                          row_begin - halo_top);
+	if (!struct_n4Interp || struct_n4Interp->pad != R) return false;
+
+	int shard_rows = row_end - row_begin;
+	cv::Mat src_rows = src_double.rowRange(halo_top, halo_top + shard_rows + 2 * R);
+	cv::Mat dst_rows = struct_dst.PGD.rowRange(row_begin, row_end);
+	cv::Mat mask_rows = flat_mask.empty() ? cv::Mat() : flat_mask.rowRange(halo_top, halo_top + shard_rows);
+	PGDClass_::Struct_ExecConfig exec_config = config.exec_config;
+	exec_config.n_threads = std::max(1, exec_config.n_threads);
+	PGDClass_::calc_ParallelTraverse(src_rows, dst_rows, *struct_n4Interp, exec_config, false, mask_rows, config.flat_code);
+
+	uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+	uintptr_t sync_begin = (uintptr_t) dst_rows.ptr(0) & ~(page - 1);
+	uintptr_t sync_end = (uintptr_t) (dst_rows.ptr(shard_rows - 1) + struct_dst.PGD.step[0]);
+	return msync((void *) sync_begin, sync_end - sync_begin, MS_SYNC) == 0;
+}
+
+#else
+
+PGDShardClass_::Struct_MappedPGD::~Struct_MappedPGD() = default;
+
+PGDShardClass_::Struct_ShardReport
+PGDShardClass_::calc_PGDFilterSharded(const cv::Mat &, const std::string &, PGDClass_::PGD_SampleNums,
+                                      PGDClass_::PGD_SampleNums, double, double, const Struct_ShardConfig &) {
+	printf("出现异常，多进程分片计算仅支持Linux\n");
+	return Struct_ShardReport();
+}
+
+std::unique_ptr<PGDShardClass_::Struct_MappedPGD> PGDShardClass_::load_MappedPGD(const std::string &, bool) {
+	printf("出现异常，映射文件仅支持Linux\n");
+	return nullptr;
+}
+
+std::unique_ptr<PGDShardClass_::Struct_MappedPGD>
+PGDShardClass_::def_MappedFile(const std::string &, int, int, PGDClass_::PGD_SampleNums, PGDClass_::PGD_SampleNums) {
+	return nullptr;
+}
+
+bool PGDShardClass_::calc_Shard(const cv::Mat &, PGDClass_::Struct_PGD &, int, int, double, double,
+                                const Struct_ShardConfig &) {
+	return false;
+}
+
+#endif
@@ -0,0 +1,231 @@
+
+#include <PGD_Tiled.h>
+#include <algorithm>
+#include <cstring>
+
+/// @file  PGD_Tiled.cpp
+/// @brief 分块存储：Morton顺序的块表、与行优先存储之间的转换、矩形与旋转框的区域遍历
+
+/*!
+ * @brief 把行优先存储的PGD结果转换为分块存储
+ * @param struct_pgd PGD结果
+ * @param tile_size 块的边长，必须是4~64之间的2的幂
+ * @return 分块存储的结果，参数不合法时为空
+ * @note 块按块坐标(tx, ty)的Morton码排序后依次存放，图像不是2的幂大小时跳过网格外的Morton码，块之间没有空洞
+ */
+PGDTiledClass_::Struct_TiledPGD PGDTiledClass_::calc_ToTiled(const PGDClass_::Struct_PGD &struct_pgd, int tile_size) {
+	Struct_TiledPGD tiled;
+	const cv::Mat &PGD = struct_pgd.PGD;
+	if (tile_size < 4 || tile_size > 64 || (tile_size & (tile_size - 1)) != 0) {
+		printf("出现异常，块的边长 %d 不是4~64之间的2的幂\n", tile_size);
+		return tiled;
+	}
+	if (PGD.empty()) {
+		printf("出现异常，calc_ToTiled 的输入为空\n");
+		return tiled;
+	}
+
+	tiled.rows = PGD.rows;
+	tiled.cols = PGD.cols;
+	tiled.n_sample = struct_pgd.n_sample;
+	tiled.n2_sample = struct_pgd.n2_sample;
+	tiled.type = PGD.type();
+	tiled.elem_size = PGD.elemSize();
+	tiled.tile_size = tile_size;
+	while ((1 << tiled.tile_shift) < tile_size) ++tiled.tile_shift;
+	tiled.tiles_y = (tiled.rows + tile_size - 1) / tile_size;
+	tiled.tiles_x = (tiled.cols + tile_size - 1) / tile_size;
+	int n_tiles = tiled.tiles_y * tiled.tiles_x;
+
+	///①块表：按Morton码排序得到每个块的存放位置
+	std::vector<std::pair<uint64, int>> order(n_tiles);
+	for (int t = 0; t < n_tiles; ++t)
+		order[t] = std::make_pair(calc_Morton((uint32_t) (t % tiled.tiles_x), (uint32_t) (t / tiled.tiles_x)), t);
+	std::sort(order.begin(), order.end());
+	tiled.tile_slot.resize(n_tiles);
+	for (int s = 0; s < n_tiles; ++s) tiled.tile_slot[order[s].second] = s;
+
+	///②逐块复制
+	size_t tile_row_bytes = (size_t) tile_size * tiled.elem_size;
+	tiled.tiles = cv::Mat::zeros(n_tiles, (int) (tile_row_bytes * tile_size), CV_8UC1);
+	cv::parallel_for_(cv::Range(0, n_tiles), [&](const cv::Range &range) {
+		for (int s = range.start; s < range.end; ++s) {
+			int t = order[s].second;
+			int row_begin = (t / tiled.tiles_x) * tile_size;
+			int col_begin = (t % tiled.tiles_x) * tile_size;
+			int height = std::min(tile_size, tiled.rows - row_begin);
+			size_t width_bytes = (size_t) std::min(tile_size, tiled.cols - col_begin) * tiled.elem_size;
+			uchar *tile_ptr = tiled.tiles.ptr(s);
+			for (int r = 0; r < height; ++r)
+				memcpy(tile_ptr + r * tile_row_bytes, PGD.ptr(row_begin + r) + col_begin * tiled.elem_size, width_bytes);
+		}
+	});
+	return tiled;
+}
+
+/*!
+ * @brief 把分块存储的结果写回行优先存储
+ * @param tiled 分块存储的结果
+ * @param struct_dst [输出] 大小与像素类型必须与tiled相同（可以使用外部内存）
+ * @return 大小或类型不一致时返回false
+ */
+bool PGDTiledClass_::calc_ToRowMajor(const Struct_TiledPGD &tiled, PGDClass_::Struct_PGD &struct_dst) {
+	cv::Mat &PGD = struct_dst.PGD;
+	if (tiled.empty() || PGD.rows != tiled.rows || PGD.cols != tiled.cols || PGD.type() != tiled.type) {
+		printf("出现异常，calc_ToRowMajor 的输出与分块结果的大小或类型不同\n");
+		return false;
+	}
+	int tile_size = tiled.tile_size;
+	size_t tile_row_bytes = (size_t) tile_size * tiled.elem_size;
+	int n_tiles = tiled.tiles_y * tiled.tiles_x;
+	cv::parallel_for_(cv::Range(0, n_tiles), [&](const cv::Range &range) {
+		for (int t = range.start; t < range.end; ++t) {
+			int row_begin = (t / tiled.tiles_x) * tile_size;
+			int col_begin = (t % tiled.tiles_x) * tile_size;
+			int height = std::min(tile_size, tiled.rows - row_begin);
+			size_t width_bytes = (size_t) std::min(tile_size, tiled.cols - col_begin) * tiled.elem_size;
+			const uchar *tile_ptr = tiled.tiles.ptr(tiled.tile_slot[t]);
+			for (int r = 0; r < height; ++r)
+				memcpy(PGD.ptr(row_begin + r) + col_begin * tiled.elem_size, tile_ptr + r * tile_row_bytes, width_bytes);
+		}
+	});
+	return true;
+}
+
+/*!
+ * @brief 读取一个矩形区域，得到行优先的小矩阵
+ * @param tiled 分块存储的结果
+ * @param rect 区域，超出图像的部分被裁掉
+ * @return 区域内的数据，类型与 Struct_PGD::PGD 相同；区域与图像不相交时为空矩阵
+ */
+cv::Mat PGDTiledClass_::calc_ReadRect(const Struct_TiledPGD &tiled, const cv::Rect &rect) {
+	cv::Rect clipped = rect & cv::Rect(0, 0, tiled.cols, tiled.rows);
+	if (tiled.empty() || clipped.area() == 0) return cv::Mat();
+	cv::Mat dst(clipped.height, clipped.width, tiled.type);
+	Struct_RegionIterator iterator(tiled, clipped);
+	Struct_RegionSpan span;
+	while (iterator.next(span))
+		memcpy(dst.ptr(span.row - clipped.y) + (span.col_begin - clipped.x) * tiled.elem_size, span.ptr,
+		       (span.col_end - span.col_begin) * tiled.elem_size);
+	return dst;
+}
+
+/*!
+ * @brief 二维Morton码：x占偶数位，y占奇数位
+ */
+uint64 PGDTiledClass_::calc_Morton(uint32_t x, uint32_t y) {
+	auto spread = [](uint64 v) {
+		v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+		v = (v | (v << 8)) & 0x00FF00FF00FF00FFULL;
+		v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		v = (v | (v << 2)) & 0x3333333333333333ULL;
+		v = (v | (v << 1)) & 0x5555555555555555ULL;
+		return v;
+	};
+	return spread(x) | (spread(y) << 1);
+}
+
+
+//=======================================================================
+//	区域遍历
+//=======================================================================
+
+/*!
+ * @brief 矩形区域
+ */
+PGDTiledClass_::Struct_RegionIterator::Struct_RegionIterator(const Struct_TiledPGD &_tiled, const cv::Rect &rect)
+		: tiled(&_tiled) {
+	cv::Rect clipped = rect & cv::Rect(0, 0, tiled->cols, tiled->rows);
+	row_begin = clipped.y;
+	col_lo.assign(clipped.height, clipped.x);
+	col_hi.assign(clipped.height, clipped.x + clipped.width);
+	init_TileList();
+}
+
+/*!
+ * @brief 旋转框区域（OpenCV的约定：angle为顺时针角度，width沿 (cosθ, sinθ) 方向）
+ * @note 框是两组平行线夹成的区域，每一行与每组平行线的交集都是一个区间，两个区间的交集即为该行的列范围
+ */
+PGDTiledClass_::Struct_RegionIterator::Struct_RegionIterator(const Struct_TiledPGD &_tiled, const cv::RotatedRect &box)
+		: tiled(&_tiled) {
+	double theta = box.angle * CV_PI / 180;
+	double c = cos(theta), s = sin(theta);
+	double half_w = box.size.width / 2.0, half_h = box.size.height / 2.0;
+	double extent_y = fabs(half_w * s) + fabs(half_h * c);
+	int row_first = std::max(0, (int) ceil(box.center.y - extent_y - 1e-9));
+	int row_last = std::min(tiled->rows - 1, (int) floor(box.center.y + extent_y + 1e-9));
+	row_begin = row_first;
+	if (row_last < row_first) return;
+
+	//|a·dx + b·dy| ≤ half 在本行（dy固定）上对应的dx区间，与[lo, hi]求交
+	auto clip_Slab = [](double a, double b_dy, double half, double &lo, double &hi) {
+		if (fabs(a) < 1e-12) {
+			if (fabs(b_dy) > half) hi = lo - 1;
+			return;
+		}
+		double x1 = (-half - b_dy) / a, x2 = (half - b_dy) / a;
+		lo = std::max(lo, std::min(x1, x2));
+		hi = std::min(hi, std::max(x1, x2));
+	};
+	for (int row = row_first; row <= row_last; ++row) {
+		double dy = row - box.center.y;
+		double lo = -1e30, hi = 1e30;
+		clip_Slab(c, s * dy, half_w, lo, hi);
+		clip_Slab(-s, c * dy, half_h, lo, hi);
+		int begin = 0, end = 0;
+		if (lo <= hi) {
+			begin = std::max(0, (int) ceil(box.center.x + lo - 1e-9));
+			end = std::min(tiled->cols, (int) floor(box.center.x + hi + 1e-9) + 1);
+			if (end < begin) end = begin;
+		}
+		col_lo.push_back(begin);
+		col_hi.push_back(end);
+	}
+	init_TileList();
+}
+
+/*!
+ * @brief 找出区域覆盖的所有块，按块在内存中的顺序排列
+ */
+void PGDTiledClass_::Struct_RegionIterator::init_TileList() {
+	int tile_size = tiled->tile_size;
+	int row_end = row_begin + (int) col_lo.size();
+	for (int row_tile = row_begin; row_tile < row_end; row_tile = (row_tile / tile_size + 1) * tile_size) {
+		int band_end = std::min(row_end, (row_tile / tile_size + 1) * tile_size);
+		int lo = tiled->cols, hi = 0;
+		for (int row = row_tile; row < band_end; ++row) {
+			if (col_lo[row - row_begin] >= col_hi[row - row_begin]) continue;
+			lo = std::min(lo, col_lo[row - row_begin]);
+			hi = std::max(hi, col_hi[row - row_begin]);
+		}
+		int ty = row_tile >> tiled->tile_shift;
+		for (int tx = lo >> tiled->tile_shift; lo < hi && tx <= (hi - 1) >> tiled->tile_shift; ++tx)
+			tile_list.push_back(ty * tiled->tiles_x + tx);
+	}
+	const std::vector<int> &tile_slot = tiled->tile_slot;
+	std::sort(tile_list.begin(), tile_list.end(), [&](int a, int b) { return tile_slot[a] < tile_slot[b]; });
+}
+
+bool PGDTiledClass_::Struct_RegionIterator::next(Struct_RegionSpan &span) {
+	int tile_size = tiled->tile_size;
+	int row_end = row_begin + (int) col_lo.size();
+	for (; tile_pos < tile_list.size(); ++tile_pos, next_row = -1) {
+		int t = tile_list[tile_pos];
+		int tile_row = (t / tiled->tiles_x) * tile_size;
+		int tile_col = (t % tiled->tiles_x) * tile_size;
+		if (next_row < 0) next_row = std::max(row_begin, tile_row);
+		int last_row = std::min(row_end, tile_row + tile_size);
+		for (; next_row < last_row; ++next_row) {
+			int lo = std::max(col_lo[next_row - row_begin], tile_col);
+			int hi = std::min(col_hi[next_row - row_begin], tile_col + tile_size);
+			if (lo >= hi) continue;
+			span.row = next_row;
+			span.col_begin = lo;
+			span.col_end = hi;
+			span.ptr = tiled->ptr(next_row, lo);
+			++next_row;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,194 @@
+
+#include <PGD.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+/// @file  PGD_Tune.cpp
+/// @brief 遍历的自动调优：对给定的参数配置和图像尺寸档位，计时比较各个遍历策略、行带高度和线程数，
+/// 把最快的组合记录下来，之后直接复用
+///
+/// 调优默认关闭，通过 Struct_PGD::tune_mode 或环境变量 PGD_AUTOTUNE 打开。
+/// 调优记录默认只保存在进程内，设置环境变量 PGD_TUNING_FILE 后才读写该文件（不会在当前目录下自动创建文件），
+/// 每行一条记录：`键 策略 行带高度 线程数 块宽 缓存预算`
+
+
+#define PGD_TUNE_MIN_PIXELS (1 << 20) ///<输出像素数少于该值时不调优：调优的计时本身就比一次正式计算还要慢
+
+static std::mutex tune_mutex;
+static std::map<std::string, PGDClass_::Struct_ExecConfig> tune_table;
+static bool tune_loaded = false;
+
+/*!
+ * @brief 调优文件的路径，未设置环境变量 PGD_TUNING_FILE 时为空（只在进程内记录）
+ */
+static std::string get_TuneFilePath() {
+	const char *env = std::getenv("PGD_TUNING_FILE");
+	return env != nullptr ? std::string(env) : std::string();
+}
+
+/*!
+ * @brief 确定实际的调优模式，PGD_Tune_Default 时读取环境变量 PGD_AUTOTUNE（1/on/auto 为自动，force 为强制），
+ * 未设置或为其他值时不调优
+ */
+static PGDClass_::PGD_TuneMode get_TuneMode(PGDClass_::PGD_TuneMode mode) {
+	if (mode != PGDClass_::PGD_Tune_Default) return mode;
+	const char *env = std::getenv("PGD_AUTOTUNE");
+	if (env == nullptr) return PGDClass_::PGD_Tune_Disable;
+	std::string value(env);
+	if (value == "1" || value == "on" || value == "auto") return PGDClass_::PGD_Tune_Auto;
+	if (value == "force") return PGDClass_::PGD_Tune_Force;
+	return PGDClass_::PGD_Tune_Disable;
+}
+
+/*!
+ * @brief 调优记录的键：方法（采样方式）、【环点】数、【子环点】数、半径、图像尺寸档位、CPU数、内核指令集，
+ * 以及调用者指定的块宽和缓存预算（调优不改变这两项）
+ * @note 尺寸档位按像素数的log2划分，相邻档位之间像素数相差一倍
+ */
+static std::string get_TuneKey(int rows, int cols, int n_sample, int n2_sample, double r1, double r2,
+                               PGDClass_::PGD_SampleMode sample_mode, bool is_44Int,
+                               const PGDClass_::Struct_ExecConfig &base) {
+	std::ostringstream key;
+	key << (is_44Int ? "44Int" : (sample_mode == PGDClass_::PGD_Sample_BoxIntegral ? "Box" : "N4"))
+	    << "_n" << n_sample << "x" << n2_sample
+	    << "_r" << r1 << "x" << r2
+	    << "_s" << (int) floor(log2(std::max(1.0, (double) rows * cols)))
+	    << "_c" << cv::getNumberOfCPUs()
+	    << "_" << PGDClass_::get_KernelISA()
+	    << "_t" << base.tile_cols << "k" << base.cache_kb;
+	return key.str();
+}
+
+///读取调优文件（调用前需要加锁）
+static void load_TuneFile() {
+	if (tune_loaded) return;
+	tune_loaded = true;
+	std::string path = get_TuneFilePath();
+	if (path.empty()) return;
+	std::ifstream file(path);
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		std::string key;
+		int strategy = 0;
+		PGDClass_::Struct_ExecConfig config;
+		//旧的记录只有前四列，块宽与缓存预算为0
+		if (!(fields >> key >> strategy >> config.band_rows >> config.n_threads)) continue;
+		fields >> config.tile_cols >> config.cache_kb;
+		config.strategy = (PGDClass_::PGD_TraverseStrategy) strategy;
+		tune_table[key] = config;
+	}
+}
+
+///写回调优文件（调用前需要加锁）
+static void save_TuneFile() {
+	std::string path = get_TuneFilePath();
+	if (path.empty()) return;
+	std::ofstream file(path, std::ios::trunc);
+	if (!file) {
+		printf("出现异常，无法写入调优文件 %s\n", path.c_str());
+		return;
+	}
+	for (const auto &item : tune_table) {
+		const PGDClass_::Struct_ExecConfig &config = item.second;
+		file << item.first << " " << (int) config.strategy << " " << config.band_rows << " " << config.n_threads << " "
+		     << config.tile_cols << " " << config.cache_kb << "\n";
+	}
+}
+
+/*!
+ * @brief 确定本次遍历的执行配置
+ * @param src 填充过的输入图像
+ * @param PGD_Data 输出图像（调优时会被写入，随后的正式遍历会覆盖）
+ * @param struct_n4Interp 输入的带权重的参数
+ * @param struct_dst 算子配置结构体，提供调优模式以及调优关闭时的执行配置
+ * @param is_44Int 是否为固化参数的44Int方法
+ * @return 执行配置
+ * @note 输出少于 PGD_TUNE_MIN_PIXELS 个像素时不调优。调优只取图像开头的一部分行（最多128行）计时，
+ * 候选从 struct_dst.exec_config 出发（保留其中的块宽与缓存预算），逐项选择，每一项固定其他项：
+ * 先比较三种遍历策略，再比较行带高度 {4, 16, 64}（分块策略不比较），最后比较线程数 {1, CPU数/2, CPU数}，
+ * 共不超过9次计时，第一个候选先预热一次
+ */
+PGDClass_::Struct_ExecConfig
+PGDClass_::calc_ExecConfig(const cv::Mat &src, cv::Mat &PGD_Data, const Struct_N4InterpList &struct_n4Interp,
+                           const Struct_PGD &struct_dst, bool is_44Int) {
+	PGD_TuneMode mode = get_TuneMode(struct_dst.tune_mode);
+	if (mode == PGD_Tune_Disable || (int64) PGD_Data.rows * PGD_Data.cols < PGD_TUNE_MIN_PIXELS) return struct_dst.exec_config;
+
+	std::string key = get_TuneKey(PGD_Data.rows, PGD_Data.cols, struct_n4Interp.n_sample, struct_n4Interp.n2_sample,
+	                              struct_n4Interp.r1, struct_n4Interp.r2, struct_dst.sample_mode, is_44Int,
+	                              struct_dst.exec_config);
+	{
+		std::lock_guard<std::mutex> lock(tune_mutex);
+		load_TuneFile();
+		auto found = tune_table.find(key);
+		if (mode == PGD_Tune_Auto && found != tune_table.end()) return found->second;
+	}
+
+	///取开头的一部分行作为计时样本
+	int R = (src.rows - PGD_Data.rows) / 2;
+	int sample_rows = std::min(PGD_Data.rows, 128);
+	cv::Mat src_sample = src.rowRange(0, sample_rows + 2 * R);
+	cv::Mat dst_sample = PGD_Data.rowRange(0, sample_rows);
+
+	int n_cpus = std::max(1, cv::getNumberOfCPUs());
+	std::vector<int> thread_list = {1};
+	if (n_cpus / 2 > 1) thread_list.push_back(n_cpus / 2);
+	if (n_cpus > 1) thread_list.push_back(n_cpus);
+	const std::vector<int> band_list = {4, 16, 64};
+
+	Struct_ExecConfig best = struct_dst.exec_config;
+	best.band_rows = 0;
+	best.n_threads = 0;
+	double best_time = -1;
+	bool warmed_up = false;
+	//计时一个候选，比当前最好的快时替换
+	auto try_Candidate = [&](const Struct_ExecConfig &candidate) {
+		if (!warmed_up) {
+			calc_ParallelTraverse(src_sample, dst_sample, struct_n4Interp, candidate, is_44Int);
+			warmed_up = true;
+		}
+		auto time_start = std::chrono::steady_clock::now();
+		calc_ParallelTraverse(src_sample, dst_sample, struct_n4Interp, candidate, is_44Int);
+		double time_used = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
+		if (best_time < 0 || time_used < best_time) {
+			best_time = time_used;
+			best = candidate;
+		}
+	};
+
+	///①遍历策略（行带高度与线程数自动）
+	Struct_ExecConfig base = best;
+	for (PGD_TraverseStrategy strategy : {PGD_Traverse_PixelWise, PGD_Traverse_RowWise, PGD_Traverse_Tiled2D}) {
+		Struct_ExecConfig candidate = base;
+		candidate.strategy = strategy;
+		try_Candidate(candidate);
+	}
+	///②行带高度（分块策略的块高按缓存预算自动选择，不比较）
+	if (best.strategy != PGD_Traverse_Tiled2D) {
+		base = best;
+		for (int band_rows : band_list) {
+			Struct_ExecConfig candidate = base;
+			candidate.band_rows = band_rows;
+			try_Candidate(candidate);
+		}
+	}
+	///③线程数
+	base = best;
+	for (int n_threads : thread_list) {
+		Struct_ExecConfig candidate = base;
+		candidate.n_threads = n_threads;
+		try_Candidate(candidate);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(tune_mutex);
+		tune_table[key] = best;
+		save_TuneFile();
+	}
+	return best;
+}